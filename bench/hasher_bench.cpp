@@ -0,0 +1,351 @@
+// ----------------------------------------------------------------------------
+// End-to-end hashing benchmark
+// Author: Hossein Taji
+//
+// Generates a reproducible synthetic tree of tiny, medium and huge files and
+// measures, for each thread count, directory discovery time, hashing
+// throughput (MB/s and files/s) of the walker, pool, reader and SHA-256
+// kernel (see hash_tree) and ThreadPool per-task overhead. Results are
+// written as JSON so they can be tracked from commit to commit.
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "picosha2.h"
+#include "DirectoryWalker.h"
+#include "FileReader.h"
+#include "ThreadPool.h"
+
+struct DatasetSpec {
+    size_t tiny = 20000;                  // 0 B to 4 KB
+    size_t medium = 200;                  // 64 KB to 4 MB
+    size_t huge = 1;
+    uint64_t huge_size = 128ull << 20;
+    size_t depth = 3;
+    size_t fanout = 4;
+    uint64_t seed = 1;
+
+    std::string id() const {
+        std::ostringstream out;
+        out << "t" << tiny << "-m" << medium << "-h" << huge << "x" << huge_size << "-d" << depth << "-f" << fanout << "-s" << seed;
+        return out.str();
+    }
+};
+
+struct Dataset {
+    std::filesystem::path root;
+    size_t files = 0;
+    uint64_t bytes = 0;
+    double generate_seconds = 0;  // 0 when an existing tree was reused
+};
+
+struct Run {
+    size_t threads;
+    double discovery_seconds;
+    size_t discovered_files;
+    double hash_seconds;
+    uint64_t hashed_bytes;
+    size_t hashed_files;
+    double enqueue_ns_per_task;
+    double range_ns_per_task;
+};
+
+// splitmix64: a fixed sequence for a given seed on every platform.
+struct Random {
+    uint64_t state;
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+    uint64_t between(uint64_t low, uint64_t high) { return low + next() % (high - low + 1); }
+};
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Every directory of a tree `depth` levels deep with `fanout` children each,
+// the root included.
+std::vector<std::filesystem::path> make_directories(const std::filesystem::path& root, size_t depth, size_t fanout) {
+    std::vector<std::filesystem::path> all = {root};
+    for (size_t level = 0, first = 0; level < depth; ++level) {
+        size_t last = all.size();
+        for (size_t i = first; i < last; ++i) {
+            for (size_t child = 0; child < fanout; ++child) all.push_back(all[i] / ("d" + std::to_string(child)));
+        }
+        first = last;
+    }
+    return all;
+}
+
+// Create the tree under `base`, or reuse it if an earlier run with the same
+// spec finished generating it.
+bool generate(const DatasetSpec& spec, const std::filesystem::path& base, Dataset& dataset) {
+    std::filesystem::path dir = base / ("hasher_bench-" + spec.id());
+    dataset.root = dir / "tree";
+    std::filesystem::path marker = dir / "complete";
+
+    std::vector<uint64_t> sizes;
+    Random random{spec.seed};
+    for (size_t i = 0; i < spec.tiny; ++i) sizes.push_back(random.between(0, 4096));
+    for (size_t i = 0; i < spec.medium; ++i) sizes.push_back(random.between(64 << 10, 4 << 20));
+    for (size_t i = 0; i < spec.huge; ++i) sizes.push_back(spec.huge_size);
+    dataset.files = sizes.size();
+    for (uint64_t size : sizes) dataset.bytes += size;
+
+    std::error_code ec;
+    if (std::filesystem::exists(marker, ec)) return true;
+
+    auto start = std::chrono::steady_clock::now();
+    std::filesystem::remove_all(dir, ec);
+    std::vector<std::filesystem::path> directories = make_directories(dataset.root, spec.depth, spec.fanout);
+    for (const auto& directory : directories) {
+        if (!std::filesystem::create_directories(directory, ec) && ec) {
+            std::cerr << "Error: Could not create " << directory.string() << ": " << ec.message() << std::endl;
+            return false;
+        }
+    }
+    // File contents are windows into one random block; the hash cost does
+    // not depend on the data.
+    std::vector<char> block(1 << 20);
+    for (size_t i = 0; i < block.size(); i += 8) {
+        uint64_t value = random.next();
+        std::copy_n(reinterpret_cast<const char*>(&value), 8, block.begin() + i);
+    }
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        std::filesystem::path path = directories[i % directories.size()] / ("f" + std::to_string(i) + ".bin");
+        std::ofstream out(path, std::ios::binary);
+        size_t offset = random.next() % block.size();
+        for (uint64_t left = sizes[i]; left > 0;) {
+            size_t piece = static_cast<size_t>(std::min<uint64_t>(left, block.size() - offset));
+            out.write(block.data() + offset, static_cast<std::streamsize>(piece));
+            left -= piece;
+            offset = 0;
+        }
+        if (!out) { std::cerr << "Error: Could not write " << path.string() << std::endl; return false; }
+    }
+    std::ofstream(marker) << spec.id() << "\n";
+    dataset.generate_seconds = seconds_since(start);
+    return true;
+}
+
+// Walk the tree and count what is found, as file_hasher's discovery does
+// (sizes included).
+double discover(const std::filesystem::path& root, size_t threads, size_t& found) {
+    std::atomic<size_t> files{0};
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(threads);
+        DirectoryWalker walker(pool, [&files](std::vector<DirectoryWalker::File>& batch) { files += batch.size(); });
+        walker.walk(root, true);
+        walker.wait();
+    }
+    found = files;
+    return seconds_since(start);
+}
+
+// Discover and hash every file on the library components file_hasher is
+// built from: the parallel DirectoryWalker feeds one range task per
+// directory to the ThreadPool, and each file is read through a per-thread
+// FileReader and hashed with the active SHA-256 kernel. It is not
+// file_hasher's full dispatch: there is no multi-buffer batching of small
+// files, no digest cache stat or lookup, and no result recording, so
+// changes to main.cpp's dispatch do not show up here.
+double hash_tree(const std::filesystem::path& root, size_t threads, size_t& files, uint64_t& bytes) {
+    std::atomic<size_t> hashed_files{0};
+    std::atomic<uint64_t> hashed_bytes{0};
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(threads);
+        auto dispatch = [&](std::vector<DirectoryWalker::File>& found) {
+            auto batch = std::make_shared<std::vector<DirectoryWalker::File>>(std::move(found));
+            pool.enqueue_range(0, batch->size(), [batch, &hashed_files, &hashed_bytes](size_t i) {
+                thread_local FileReader reader;
+                picosha2::hash256_one_by_one hasher;
+                uint64_t size = 0;
+                bool ok = reader.read((*batch)[i].path, [&](const unsigned char* data, size_t length) {
+                    hasher.process(data, data + length);
+                    size += length;
+                });
+                if (!ok) return;
+                hasher.finish();
+                hashed_bytes += size;
+                ++hashed_files;
+            });
+        };
+        DirectoryWalker walker(pool, dispatch, nullptr, false);
+        walker.walk(root, true);
+        walker.wait();
+    }
+    files = hashed_files;
+    bytes = hashed_bytes;
+    return seconds_since(start);
+}
+
+// Average wall time per empty task, submitted one enqueue() at a time or
+// as a single enqueue_range().
+double task_overhead_ns(size_t threads, size_t count, bool range) {
+    std::atomic<size_t> done{0};
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(threads);
+        if (range) pool.enqueue_range(0, count, [&done](size_t) { done.fetch_add(1, std::memory_order_relaxed); });
+        else for (size_t i = 0; i < count; ++i) pool.enqueue([&done] { done.fetch_add(1, std::memory_order_relaxed); });
+        while (done.load() < count) std::this_thread::yield();
+    }
+    return seconds_since(start) * 1e9 / count;
+}
+
+std::string json_string(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+void write_json(std::ostream& out, const std::string& label, const DatasetSpec& spec, const Dataset& dataset,
+                size_t repeat, const std::vector<Run>& runs) {
+    out << "{\n";
+    out << "  \"label\": " << json_string(label) << ",\n";
+    out << "  \"hash_impl\": " << json_string(picosha2::block_impl_name(picosha2::current_block_impl())) << ",\n";
+    out << "  \"repeat\": " << repeat << ",\n";
+    out << "  \"dataset\": {\"id\": " << json_string(spec.id()) << ", \"root\": " << json_string(dataset.root.string())
+        << ", \"tiny\": " << spec.tiny << ", \"medium\": " << spec.medium << ", \"huge\": " << spec.huge
+        << ", \"huge_size\": " << spec.huge_size << ", \"depth\": " << spec.depth << ", \"fanout\": " << spec.fanout
+        << ", \"seed\": " << spec.seed << ", \"files\": " << dataset.files << ", \"bytes\": " << dataset.bytes
+        << ", \"generate_seconds\": " << dataset.generate_seconds << "},\n";
+    out << "  \"runs\": [\n";
+    for (size_t i = 0; i < runs.size(); ++i) {
+        const Run& run = runs[i];
+        out << "    {\"threads\": " << run.threads
+            << ", \"discovery_seconds\": " << run.discovery_seconds
+            << ", \"discovered_files\": " << run.discovered_files
+            << ", \"hash_seconds\": " << run.hash_seconds
+            << ", \"hashed_files\": " << run.hashed_files
+            << ", \"hashed_bytes\": " << run.hashed_bytes
+            << ", \"mb_per_second\": " << run.hashed_bytes / 1e6 / run.hash_seconds
+            << ", \"files_per_second\": " << run.hashed_files / run.hash_seconds
+            << ", \"enqueue_ns_per_task\": " << run.enqueue_ns_per_task
+            << ", \"range_ns_per_task\": " << run.range_ns_per_task << "}" << (i + 1 < runs.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+// Parse a list such as "1,2,4".
+bool parse_list(const std::string& text, std::vector<size_t>& values) {
+    values.clear();
+    std::istringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        try { values.push_back(std::stoul(item)); } catch (...) { return false; }
+        if (values.back() == 0) return false;
+    }
+    return !values.empty();
+}
+
+void print_usage(const char* prog_name) {
+    std::cerr << "Usage: " << prog_name << " [options]" << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --dir <path>          Where to generate the dataset. Defaults to the system temp directory." << std::endl;
+    std::cerr << "  --tiny <n>            Files of 0 B to 4 KB. Defaults to 20000." << std::endl;
+    std::cerr << "  --medium <n>          Files of 64 KB to 4 MB. Defaults to 200." << std::endl;
+    std::cerr << "  --huge <n>            Files of --huge-size bytes. Defaults to 1." << std::endl;
+    std::cerr << "  --huge-size <bytes>   Defaults to 134217728 (128 MB)." << std::endl;
+    std::cerr << "  --depth <n>           Directory levels below the root. Defaults to 3." << std::endl;
+    std::cerr << "  --fanout <n>          Subdirectories per directory. Defaults to 4." << std::endl;
+    std::cerr << "  --seed <n>            Seed for file sizes and contents. Defaults to 1." << std::endl;
+    std::cerr << "  -j <list>             Thread counts to measure, e.g. 1,2,4. Defaults to 1,2,4 and the core count." << std::endl;
+    std::cerr << "  --repeat <n>          Runs per measurement; the fastest is reported. Defaults to 3." << std::endl;
+    std::cerr << "  --tasks <n>           Empty tasks for the pool overhead measurement. Defaults to 1000000." << std::endl;
+    std::cerr << "  --label <text>        Stored in the JSON, e.g. a commit id." << std::endl;
+    std::cerr << "  -o <file>             Write the JSON there instead of to stdout." << std::endl;
+    std::cerr << "  --clean               Delete the dataset afterwards." << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    DatasetSpec spec;
+    std::filesystem::path base = std::filesystem::temp_directory_path();
+    std::vector<size_t> thread_counts = {1, 2, 4};
+    size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+    if (std::find(thread_counts.begin(), thread_counts.end(), hardware) == thread_counts.end()) thread_counts.push_back(hardware);
+    size_t repeat = 3;
+    size_t tasks = 1000000;
+    std::string label, output_path;
+    bool clean = false;
+    for (size_t i = 0; i < args.size(); ++i) {
+        bool has_value = i + 1 < args.size();
+        try {
+            if (args[i] == "--dir" && has_value) { base = args[++i]; }
+            else if (args[i] == "--tiny" && has_value) { spec.tiny = std::stoul(args[++i]); }
+            else if (args[i] == "--medium" && has_value) { spec.medium = std::stoul(args[++i]); }
+            else if (args[i] == "--huge" && has_value) { spec.huge = std::stoul(args[++i]); }
+            else if (args[i] == "--huge-size" && has_value) { spec.huge_size = std::stoull(args[++i]); }
+            else if (args[i] == "--depth" && has_value) { spec.depth = std::stoul(args[++i]); }
+            else if (args[i] == "--fanout" && has_value) { spec.fanout = std::max<size_t>(1, std::stoul(args[++i])); }
+            else if (args[i] == "--seed" && has_value) { spec.seed = std::stoull(args[++i]); }
+            else if (args[i] == "-j" && has_value) { if (!parse_list(args[++i], thread_counts)) { print_usage(argv[0]); return 1; } }
+            else if (args[i] == "--repeat" && has_value) { repeat = std::max<size_t>(1, std::stoul(args[++i])); }
+            else if (args[i] == "--tasks" && has_value) { tasks = std::max<size_t>(1, std::stoul(args[++i])); }
+            else if (args[i] == "--label" && has_value) { label = args[++i]; }
+            else if (args[i] == "-o" && has_value) { output_path = args[++i]; }
+            else if (args[i] == "--clean") { clean = true; }
+            else { print_usage(argv[0]); return 1; }
+        } catch (...) { print_usage(argv[0]); return 1; }
+    }
+
+    // Progress goes to stderr so stdout carries only the JSON.
+    Dataset dataset;
+    std::cerr << "Preparing dataset " << spec.id() << " under " << base.string() << "..." << std::endl;
+    if (!generate(spec, base, dataset)) return 1;
+    std::cerr << dataset.files << " files, " << dataset.bytes << " bytes"
+              << (dataset.generate_seconds > 0 ? "" : " (reused)") << "." << std::endl;
+
+    // One untimed pass loads the tree into the page cache, so every run
+    // measures the same thing.
+    size_t files;
+    uint64_t bytes;
+    hash_tree(dataset.root, thread_counts.front(), files, bytes);
+
+    std::vector<Run> runs;
+    for (size_t threads : thread_counts) {
+        Run run{threads, 1e30, 0, 1e30, 0, 0, 1e30, 1e30};
+        for (size_t r = 0; r < repeat; ++r) {
+            run.discovery_seconds = std::min(run.discovery_seconds, discover(dataset.root, threads, run.discovered_files));
+            run.hash_seconds = std::min(run.hash_seconds, hash_tree(dataset.root, threads, run.hashed_files, run.hashed_bytes));
+            run.enqueue_ns_per_task = std::min(run.enqueue_ns_per_task, task_overhead_ns(threads, tasks, false));
+            run.range_ns_per_task = std::min(run.range_ns_per_task, task_overhead_ns(threads, tasks, true));
+        }
+        std::cerr << "-j " << threads << ": discovery " << run.discovery_seconds << " s, hashing "
+                  << run.hashed_bytes / 1e6 / run.hash_seconds << " MB/s, " << run.hashed_files / run.hash_seconds << " files/s" << std::endl;
+        runs.push_back(run);
+    }
+
+    if (output_path.empty()) {
+        write_json(std::cout, label, spec, dataset, repeat, runs);
+    } else {
+        std::ofstream out(output_path);
+        write_json(out, label, spec, dataset, repeat, runs);
+        if (!out) { std::cerr << "Error: Could not write " << output_path << std::endl; return 1; }
+    }
+    if (clean) {
+        std::error_code ec;
+        std::filesystem::remove_all(dataset.root.parent_path(), ec);
+    }
+    return 0;
+}
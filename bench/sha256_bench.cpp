@@ -0,0 +1,163 @@
+// ----------------------------------------------------------------------------
+// SHA-256 kernel microbenchmark
+// Author: Hossein Taji
+//
+// Measures the picosha2 core in cycles/byte for message sizes from 0 B to
+// 1 GB, for every block kernel the CPU supports: the raw block compression
+// function, hash256_one_by_one over a buffer in memory, and picosha2's
+// std::ifstream overload, which reads through istreambuf_iterator. That
+// overload never reaches the block kernels (its iterators are not byte
+// pointers), so it is only measured on the scalar rows. Small sizes stay in
+// cache; the largest stream from DRAM or the page cache.
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include "picosha2.h"
+
+// Time-stamp counter ticks: reference cycles at the nominal frequency, so
+// results are comparable across runs even when the core clock changes.
+// Without a TSC, nanoseconds are reported instead.
+uint64_t ticks() {
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// Repeat `work` until it has run for at least `min_seconds`, three times
+// over, and return the lowest ticks per call.
+template <typename Work>
+double measure(Work&& work, double min_seconds) {
+    double best = 1e300;
+    for (int round = 0; round < 3; ++round) {
+        size_t calls = 0;
+        auto start = std::chrono::steady_clock::now();
+        uint64_t first = ticks();
+        do {
+            work();
+            ++calls;
+        } while (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() < min_seconds);
+        best = std::min(best, double(ticks() - first) / calls);
+    }
+    return best;
+}
+
+// Keep results observable so the work is not optimised away.
+volatile unsigned char sink;
+
+// Ticks per byte, or per call for an empty message.
+std::string format_cost(double ticks_per_call, uint64_t size) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2) << (size ? ticks_per_call / size : ticks_per_call) << (size ? "" : "/call");
+    return out.str();
+}
+
+std::string format_size(uint64_t size) {
+    if (size >= (1u << 30)) return std::to_string(size >> 30) + " GB";
+    if (size >= (1u << 20)) return std::to_string(size >> 20) + " MB";
+    if (size >= (1u << 10)) return std::to_string(size >> 10) + " KB";
+    return std::to_string(size) + " B";
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t max_size = 1ull << 30;
+    double min_seconds = 0.2;
+    if (argc > 1) {
+        // Largest message, with an optional K, M or G suffix.
+        size_t end = 0;
+        max_size = std::stoull(argv[1], &end);
+        char suffix = argv[1][end];
+        max_size <<= suffix == 'K' || suffix == 'k' ? 10 : suffix == 'M' || suffix == 'm' ? 20 : suffix == 'G' || suffix == 'g' ? 30 : 0;
+    }
+    std::vector<uint64_t> sizes;
+    for (uint64_t size : {0ull, 64ull, 1ull << 10, 64ull << 10, 1ull << 20, 1ull << 30}) {
+        if (size <= max_size) sizes.push_back(size);
+    }
+
+    std::vector<unsigned char> message(static_cast<size_t>(sizes.back()));
+    uint32_t seed = 12345;
+    for (unsigned char& byte : message) { seed = seed * 1103515245u + 12345u; byte = static_cast<unsigned char>(seed >> 24); }
+
+    // One file per size for the stream path, read back through the page cache.
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "sha256_bench";
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    std::vector<std::filesystem::path> files;
+    for (uint64_t size : sizes) {
+        files.push_back(directory / ("message-" + std::to_string(size)));
+        std::ofstream out(files.back(), std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(message.data()), static_cast<std::streamsize>(size));
+    }
+
+#ifdef HAVE_TSC
+    const char* unit = "TSC cycles/byte";
+#else
+    const char* unit = "ns/byte";
+#endif
+    std::cout << unit << " (lower is better); block = block kernel on whole 64-byte blocks, one_by_one = "
+              << "hash256_one_by_one in memory," << std::endl
+              << "istreambuf = picosha2::hash256(std::ifstream&), which always runs the portable scalar code (scalar rows only)" << std::endl;
+    std::cout << "kernel  size      block        one_by_one   istreambuf" << std::endl;
+    for (picosha2::block_impl impl : {picosha2::block_impl::scalar, picosha2::block_impl::shani}) {
+        if (!picosha2::set_block_impl(impl)) { std::cout << picosha2::block_impl_name(impl) << "   not supported on this CPU" << std::endl; continue; }
+        picosha2::detail::block_fn_t block = picosha2::block_impl_function(impl);
+        for (size_t i = 0; i < sizes.size(); ++i) {
+            const uint64_t size = sizes[i];
+            const unsigned char* data = message.data();
+
+            picosha2::word_t state[8];
+            std::copy(picosha2::detail::initial_message_digest, picosha2::detail::initial_message_digest + 8, state);
+            double block_cost = measure([&] {
+                block(state, data, static_cast<size_t>(size / 64));
+                sink = static_cast<unsigned char>(state[0]);
+            }, min_seconds);
+
+            double one_by_one_cost = measure([&] {
+                picosha2::hash256_one_by_one hasher;
+                hasher.process(data, data + size);
+                hasher.finish();
+                unsigned char digest[32];
+                hasher.get_hash_bytes(digest, digest + 32);
+                sink = digest[0];
+            }, min_seconds);
+
+            std::string stream_cost = "-";
+            if (impl == picosha2::block_impl::scalar) {
+                stream_cost = format_cost(measure([&] {
+                    std::ifstream in(files[i], std::ios::binary);
+                    unsigned char digest[32];
+                    picosha2::hash256(in, digest, digest + 32);
+                    sink = digest[0];
+                }, min_seconds), size);
+            }
+
+            std::cout << std::left << std::setw(8) << picosha2::block_impl_name(impl) << std::setw(10) << format_size(size)
+                      << std::setw(13) << format_cost(block_cost, size / 64 * 64) << std::setw(13) << format_cost(one_by_one_cost, size)
+                      << stream_cost << std::right << std::endl;
+        }
+    }
+    std::filesystem::remove_all(directory, ec);
+    return 0;
+}
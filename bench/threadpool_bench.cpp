@@ -0,0 +1,200 @@
+// ----------------------------------------------------------------------------
+// ThreadPool microbenchmark
+// Author: Hossein Taji
+//
+// Measures tasks/sec for tiny tasks on the work-stealing ThreadPool against the
+// original mutex + std::queue design, which is reproduced below as a baseline,
+// and counts heap allocations per task.
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ThreadPool.h"
+
+// Count every heap allocation in the process.
+std::atomic<size_t> allocations{0};
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+// Stands in for the std::filesystem::path a real hashing task captures.
+using Payload = std::array<char, 40>;
+
+// The previous ThreadPool: one mutex and condition variable for every task.
+class MutexThreadPool {
+public:
+    explicit MutexThreadPool(size_t num_threads) : stop(false) {
+        for (size_t i = 0; i < num_threads; ++i) workers.emplace_back([this] { worker(); });
+    }
+    ~MutexThreadPool() {
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            stop = true;
+        }
+        condition.notify_all();
+        for (std::thread& worker : workers) worker.join();
+    }
+    void enqueue(std::function<void()> task) {
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            tasks.push(std::move(task));
+        }
+        condition.notify_one();
+    }
+    // No per-worker queues: children go through the shared queue too.
+    void spawn(std::function<void()> task) { enqueue(std::move(task)); }
+
+private:
+    void worker() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                condition.wait(lock, [this] { return stop || !tasks.empty(); });
+                if (stop && tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex queue_mutex;
+    std::condition_variable condition;
+    bool stop;
+};
+
+// Submit `count` tiny tasks from one external thread; the pool destructor
+// acts as the barrier. Returns tasks per second.
+template <typename Pool>
+double external_submit(size_t threads, size_t count) {
+    std::atomic<size_t> done{0};
+    auto start = std::chrono::steady_clock::now();
+    {
+        Pool pool(threads);
+        for (size_t i = 0; i < count; ++i) pool.enqueue([&done] { done.fetch_add(1, std::memory_order_relaxed); });
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return done.load() / seconds;
+}
+
+// Every task spawns two children until `depth` is reached, the pattern a
+// parallel directory walk produces. Children use spawn(), which stays on the
+// worker's own deque in the work-stealing pool. Returns tasks per second.
+template <typename Pool>
+double recursive_spawn(size_t threads, int depth) {
+    std::atomic<size_t> done{0};
+    auto start = std::chrono::steady_clock::now();
+    {
+        Pool pool(threads);
+        std::function<void(int)> spawn = [&](int level) {
+            done.fetch_add(1, std::memory_order_relaxed);
+            if (level == 0) return;
+            pool.spawn([&spawn, level] { spawn(level - 1); });
+            pool.spawn([&spawn, level] { spawn(level - 1); });
+        };
+        pool.enqueue([&spawn, depth] { spawn(depth); });
+        // Let the tree finish before the destructor stops the workers.
+        size_t expected = (size_t(1) << (depth + 1)) - 1;
+        while (done.load() < expected) std::this_thread::yield();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return done.load() / seconds;
+}
+
+struct Result {
+    double tasks_per_second;
+    double allocations_per_task;
+};
+
+// Submit `count` tasks that each capture a path-sized payload, one enqueue()
+// per task. std::function has to heap-allocate such a capture; Task does not.
+template <typename Pool>
+Result payload_submit(size_t threads, size_t count) {
+    std::atomic<size_t> done{0};
+    Payload payload{};
+    auto start = std::chrono::steady_clock::now();
+    size_t before;
+    {
+        Pool pool(threads);
+        before = allocations.load();
+        for (size_t i = 0; i < count; ++i) {
+            pool.enqueue([&done, payload] { done.fetch_add(payload[0] + 1, std::memory_order_relaxed); });
+        }
+    }
+    size_t allocated = allocations.load() - before;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return {done.load() / seconds, double(allocated) / count};
+}
+
+// Process a pre-built array of `count` payloads with one enqueue_range() call.
+Result bulk_submit(size_t threads, size_t count) {
+    std::atomic<size_t> done{0};
+    std::vector<Payload> items(count);
+    auto start = std::chrono::steady_clock::now();
+    size_t before;
+    {
+        ThreadPool pool(threads);
+        before = allocations.load();
+        pool.enqueue_range(0, items.size(), [&done, &items](size_t i) {
+            done.fetch_add(items[i][0] + 1, std::memory_order_relaxed);
+        });
+        while (done.load() < count) std::this_thread::yield();
+    }
+    size_t allocated = allocations.load() - before;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return {done.load() / seconds, double(allocated) / count};
+}
+
+int main(int argc, char* argv[]) {
+    size_t count = argc > 1 ? std::stoul(argv[1]) : 1000000;
+    const int depth = 18;
+    std::vector<size_t> thread_counts = {1, 2, 4};
+    size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+    if (std::find(thread_counts.begin(), thread_counts.end(), hardware) == thread_counts.end()) thread_counts.push_back(hardware);
+
+    std::cout << "tasks/sec (higher is better), " << count << " external tasks, "
+              << ((size_t(1) << (depth + 1)) - 1) << " recursive tasks" << std::endl;
+    std::cout << "threads  external(mutex)  external(pool)  recursive(mutex)  recursive(pool)" << std::endl;
+    for (size_t threads : thread_counts) {
+        std::cout << threads << "\t "
+                  << static_cast<long long>(external_submit<MutexThreadPool>(threads, count)) << "\t\t  "
+                  << static_cast<long long>(external_submit<ThreadPool>(threads, count)) << "\t  "
+                  << static_cast<long long>(recursive_spawn<MutexThreadPool>(threads, depth)) << "\t    "
+                  << static_cast<long long>(recursive_spawn<ThreadPool>(threads, depth)) << std::endl;
+    }
+
+    std::cout << std::endl << "tasks/sec (allocations/task), " << count << " tasks capturing a "
+              << sizeof(Payload) << "-byte payload" << std::endl;
+    std::cout << "threads  enqueue(mutex)     enqueue(pool)      enqueue_range(pool)" << std::endl;
+    for (size_t threads : thread_counts) {
+        Result mutex_pool = payload_submit<MutexThreadPool>(threads, count);
+        Result pool = payload_submit<ThreadPool>(threads, count);
+        Result bulk = bulk_submit(threads, count);
+        std::cout << threads;
+        for (const Result& result : {mutex_pool, pool, bulk}) {
+            std::cout << "\t " << static_cast<long long>(result.tasks_per_second) << " (" << result.allocations_per_task << ")";
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,149 @@
+#ifndef ASYNC_READER_H
+#define ASYNC_READER_H
+
+// Author: Hossein Taji
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "ThreadPool.h"
+
+// Reads files asynchronously on a dedicated I/O thread and hands completed
+// blocks to hash tasks on a ThreadPool, so the number of reads in flight
+// (queue depth) and the number of hashing threads are tuned independently.
+//
+// Reads land in a fixed pool of `queue_depth` buffers. With io_uring the pool
+// is registered with the kernel and filled with fixed-buffer reads; where
+// io_uring is unavailable, a set of plain pread() threads does the I/O.
+class AsyncReader {
+public:
+    enum class Backend { uring, pread };
+
+    // Called on a pool worker for each block of a file, in file order. Calls
+    // for one file never overlap.
+    using BlockConsumer = std::function<void(const unsigned char* data, size_t size)>;
+    // Called once per file on a pool worker after its last block; `ok` is
+    // false if the file could not be opened or read.
+    using DoneCallback = std::function<void(bool ok)>;
+
+    static constexpr size_t kDefaultQueueDepth = 64;
+    static constexpr size_t kDefaultBlockSize = 256 * 1024;
+
+    // Whether io_uring can be used on this system.
+    static bool uring_available();
+    static const char* backend_name(Backend backend);
+
+    // Asking for io_uring falls back to pread threads when it is unavailable.
+    AsyncReader(ThreadPool& pool, Backend backend = Backend::uring,
+                size_t queue_depth = kDefaultQueueDepth, size_t block_size = kDefaultBlockSize);
+    ~AsyncReader();
+
+    AsyncReader(const AsyncReader&) = delete;
+    AsyncReader& operator=(const AsyncReader&) = delete;
+
+    Backend backend() const { return backend_; }
+
+    // Queue a file for reading.
+    void submit(std::filesystem::path path, BlockConsumer on_block, DoneCallback on_done);
+
+    // Block until every submitted file has finished.
+    void wait();
+
+private:
+    struct Chunk {
+        size_t buffer;
+        size_t length;
+    };
+
+    struct Job {
+        std::filesystem::path path;
+        BlockConsumer on_block;
+        DoneCallback on_done;
+        int fd = -1;
+        uint64_t size = 0;
+        size_t chunks = 0;         // blocks in the file; fewer if it ends early
+        size_t next_submit = 0;    // next block to issue a read for
+        size_t next_deliver = 0;   // next block to hand to on_block
+        size_t inflight = 0;
+        bool draining = false;     // a pool task is consuming blocks
+        bool failed = false;
+        std::map<size_t, Chunk> ready;  // completed blocks awaiting delivery
+    };
+
+    // One outstanding read; indexed by the buffer it reads into.
+    struct Request {
+        Job* job;
+        size_t chunk;
+        size_t length;
+        size_t done;   // bytes already read by earlier partial completions
+        bool reading;  // issued and not yet completed
+    };
+
+    struct Completion {
+        size_t buffer;
+        long result;
+    };
+
+    class Uring;
+
+    void run();
+    void admit_files(std::unique_lock<std::mutex>& lock);
+    std::vector<size_t> schedule_reads_locked();
+    void issue_reads(const std::vector<size_t>& buffers);
+    void handle_completion_locked(const Completion& completion);
+    void drain(Job* job);
+    void fail_job_locked(Job* job);
+    void end_file_locked(Job* job, size_t chunks);
+    void maybe_finish_locked(Job* job);
+    void enqueue_deferred(std::unique_lock<std::mutex>& lock);
+    void release_buffer_locked(size_t buffer);
+    void wake_io_locked();
+    void fall_back_to_pread_locked();
+    void pread_worker();
+    unsigned char* buffer(size_t index) const { return buffer_addresses_[index]; }
+
+    ThreadPool& pool_;
+    Backend backend_;
+    size_t queue_depth_;
+    size_t block_size_;
+    unsigned char* buffers_;
+    std::vector<unsigned char*> buffer_addresses_;  // per buffer: in buffers_, or a spare
+    std::vector<unsigned char*> spare_buffers_;     // replacements after an io_uring failure
+    std::unique_ptr<Uring> uring_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;   // wakes the I/O thread
+    std::condition_variable idle_;   // signalled when a file finishes
+    std::deque<std::unique_ptr<Job>> pending_;           // submitted, not yet opened
+    std::unordered_map<Job*, std::unique_ptr<Job>> jobs_;  // opened files
+    std::deque<Job*> submittable_;   // opened files with blocks left to read
+    std::vector<size_t> free_buffers_;
+    std::vector<Request> requests_;
+    std::vector<Completion> completions_;  // filled by pread workers
+    std::vector<size_t> retries_;          // partially completed reads to resume
+    size_t inflight_ = 0;
+    size_t outstanding_files_ = 0;
+    bool io_waiting_ = false;              // the I/O thread is in Uring::wait()
+    std::vector<Task> deferred_tasks_;     // for the pool, queued under the lock
+    size_t deferred_finished_ = 0;         // files whose callback is in deferred_tasks_
+    bool stop_ = false;
+
+    // pread backend
+    std::deque<size_t> read_queue_;
+    std::condition_variable read_ready_;
+    std::vector<std::thread> pread_threads_;
+
+    std::thread io_thread_;
+};
+
+#endif // ASYNC_READER_H
@@ -0,0 +1,77 @@
+#ifndef DIRECTORY_WALKER_H
+#define DIRECTORY_WALKER_H
+
+// Author: Hossein Taji
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ThreadPool.h"
+
+// Walks a directory tree in parallel: every directory is scanned by its own
+// ThreadPool task. On Linux entries are read in bulk with getdents64, d_type
+// avoids a stat() per entry where the filesystem provides it, and
+// subdirectories are opened relative to their parent's descriptor with
+// openat() so no path is resolved twice.
+class DirectoryWalker {
+public:
+    static constexpr std::uintmax_t kUnknownSize = static_cast<std::uintmax_t>(-1);
+
+    // An accepted regular file. `size` is kUnknownSize unless sizes were requested.
+    struct File {
+        std::filesystem::path path;
+        std::uintmax_t size;
+    };
+
+    // Called with the accepted files of a directory in batches (one per
+    // getdents64 read), concurrently from pool workers. The callee may move
+    // the files out.
+    using FileCallback = std::function<void(std::vector<File>& files)>;
+    // Decides from the file name alone whether a file is wanted; empty accepts all.
+    using NameFilter = std::function<bool(const std::string& name)>;
+
+    DirectoryWalker(ThreadPool& pool, FileCallback on_files, NameFilter accept = nullptr,
+                    bool need_sizes = true);
+
+    DirectoryWalker(const DirectoryWalker&) = delete;
+    DirectoryWalker& operator=(const DirectoryWalker&) = delete;
+
+    // Start walking `root`; returns immediately. Returns false if `root`
+    // cannot be opened.
+    bool walk(const std::filesystem::path& root, bool recursive);
+
+    // Block until every directory has been scanned.
+    void wait();
+
+    // Directories that could not be read, with the reason.
+    std::vector<std::string> errors();
+
+private:
+    struct Directory;
+
+    void spawn(std::shared_ptr<Directory> parent, std::string name);
+    void scan(std::shared_ptr<Directory> directory);
+    void report_files(std::vector<File>& files);
+    void add_error(const std::string& path, int error);
+    void finish_one();
+
+    ThreadPool& pool_;
+    FileCallback on_files_;
+    NameFilter accept_;
+    bool need_sizes_;
+    bool recursive_ = true;
+
+    std::atomic<size_t> pending_{0};
+    std::mutex mutex_;
+    std::condition_variable done_;
+    std::vector<std::string> errors_;
+};
+
+#endif // DIRECTORY_WALKER_H
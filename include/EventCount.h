@@ -0,0 +1,54 @@
+#ifndef EVENT_COUNT_H
+#define EVENT_COUNT_H
+
+// Author: Hossein Taji
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+// Lets threads sleep on a condition guarded by lock-free data. A waiter
+// announces itself with prepare_wait(), re-checks its condition, and then
+// either cancel_wait()s or wait()s. Notifiers touch the mutex only when
+// someone is actually waiting, so the fast path is a fence and a load.
+class EventCount {
+public:
+    using Key = unsigned;
+
+    Key prepare_wait() {
+        waiters_.fetch_add(1, std::memory_order_seq_cst);
+        return epoch_.load(std::memory_order_seq_cst);
+    }
+
+    void cancel_wait() { waiters_.fetch_sub(1, std::memory_order_relaxed); }
+
+    // Sleep until a notify that happened after prepare_wait() returned `key`.
+    void wait(Key key) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_.wait(lock, [&] { return epoch_.load(std::memory_order_relaxed) != key; });
+        }
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void notify_one() { notify(false); }
+    void notify_all() { notify(true); }
+
+private:
+    void notify(bool all) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters_.load(std::memory_order_relaxed) == 0) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            epoch_.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (all) condition_.notify_all(); else condition_.notify_one();
+    }
+
+    std::atomic<Key> epoch_{0};
+    std::atomic<int> waiters_{0};
+    std::mutex mutex_;
+    std::condition_variable condition_;
+};
+
+#endif // EVENT_COUNT_H
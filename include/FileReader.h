@@ -0,0 +1,63 @@
+#ifndef FILE_READER_H
+#define FILE_READER_H
+
+// Author: Hossein Taji
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+
+// Reads a file in large blocks into a single reusable, page-aligned buffer.
+// Each worker thread keeps its own FileReader so the buffer is allocated once
+// per thread rather than once per file.
+//
+// In mmap mode the file is instead mapped read-only and handed to the
+// consumer straight from the page cache, one large window at a time. If the
+// file is truncated meanwhile, the SIGBUS is caught and read() returns false;
+// the consumer is abandoned mid-call, so it must not hold anything that
+// needs cleaning up.
+class FileReader {
+public:
+    enum class Mode { read, mmap };
+
+    // Called for every block read from the file, in file order.
+    using BlockConsumer = std::function<void(const unsigned char* data, size_t size)>;
+
+    static constexpr size_t kDefaultBlockSize = 1 << 20;  // 1 MiB
+    static constexpr size_t kBufferAlignment = 4096;
+    static constexpr size_t kMapWindowSize = 64 << 20;    // 64 MiB
+
+    explicit FileReader(Mode mode = Mode::read, size_t block_size = kDefaultBlockSize);
+    ~FileReader();
+
+    FileReader(const FileReader&) = delete;
+    FileReader& operator=(const FileReader&) = delete;
+
+    // Stream the whole file through `consume`. Returns false if the file
+    // could not be opened or a read error occurred.
+    bool read(const std::filesystem::path& path, const BlockConsumer& consume);
+
+    // Stream `length` bytes starting at `offset` (fewer if the file ends
+    // first). Always uses plain reads, whatever the mode.
+    bool read_range(const std::filesystem::path& path, uint64_t offset, uint64_t length,
+                    const BlockConsumer& consume);
+
+    size_t block_size() const { return block_size_; }
+    Mode mode() const { return mode_; }
+
+    // Parse "read" / "mmap". Returns false for an unknown name.
+    static bool parse_mode(const std::string& name, Mode& mode);
+    static const char* mode_name(Mode mode);
+
+private:
+    bool read_blocks(int fd, const BlockConsumer& consume);
+    bool read_mapped(int fd, const BlockConsumer& consume);
+
+    Mode mode_;
+    unsigned char* buffer_;
+    size_t block_size_;
+};
+
+#endif // FILE_READER_H
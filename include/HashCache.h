@@ -0,0 +1,100 @@
+#ifndef HASH_CACHE_H
+#define HASH_CACHE_H
+
+// Author: Hossein Taji
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Persistent map from a file's identity and version to its digest, so a
+// rescan of an unchanged file costs one stat() instead of a full read.
+//
+// On disk the cache is a small header followed by fixed-size records that
+// can be used in place from a read-only mapping. New digests are appended at
+// save(); a later record for the same file (device, inode and kind)
+// supersedes the earlier ones, and the file is compacted once superseded
+// records outnumber live ones.
+class HashCache {
+public:
+    using Digest = std::array<unsigned char, 32>;
+
+    // A file version: any write, truncation, chmod or replacement changes
+    // mtime, ctime, size or inode. `kind` identifies the digest algorithm
+    // (kSha256, or a tree-hash chunk size).
+    struct Key {
+        uint64_t device;
+        uint64_t inode;
+        uint64_t size;
+        int64_t mtime_ns;
+        int64_t ctime_ns;
+        uint64_t kind;
+
+        bool operator==(const Key& other) const;
+    };
+
+    static constexpr uint64_t kSha256 = 0;
+
+    // ~/.cache/parallel-file-hasher/hashes.cache (or under $XDG_CACHE_HOME);
+    // empty when no home directory is known.
+    static std::filesystem::path default_path();
+
+    // Stat `path` (following symlinks) into a key. Returns false when the
+    // file cannot be stat'ed or the platform has no inode numbers.
+    static bool make_key(const std::filesystem::path& path, uint64_t kind, Key& key);
+
+    // Load the cache at `file`; a missing or unreadable file starts empty.
+    // With `rebuild` the existing contents are ignored and replaced at save().
+    explicit HashCache(std::filesystem::path file, bool rebuild = false);
+    ~HashCache();
+
+    HashCache(const HashCache&) = delete;
+    HashCache& operator=(const HashCache&) = delete;
+
+    // Thread-safe and lock-free: only entries loaded from disk are visible.
+    bool lookup(const Key& key, Digest& digest);
+
+    // Remember a digest for the next run. Thread-safe.
+    void insert(const Key& key, const Digest& digest);
+
+    // Write inserted entries to disk. Returns false on an I/O error.
+    bool save();
+
+    const std::filesystem::path& file() const { return file_; }
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+
+private:
+    struct Record;
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    void load();
+    const Record* file_records() const;
+    bool rewrite(const std::vector<Record>& records);
+
+    std::filesystem::path file_;
+    bool rebuild_;
+
+    const unsigned char* mapping_ = nullptr;  // the whole file, read-only
+    size_t mapping_size_ = 0;
+    std::vector<unsigned char> contents_;     // used where there is no mmap()
+    size_t file_records_ = 0;
+    std::unordered_map<Key, const Record*, KeyHash> index_;
+
+    std::mutex pending_mutex_;
+    std::vector<Record> pending_;
+
+    std::atomic<size_t> hits_{0};
+    std::atomic<size_t> misses_{0};
+};
+
+#endif // HASH_CACHE_H
@@ -0,0 +1,80 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+// Author: Hossein Taji
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// Append-only checkpoint log of finished files, so an interrupted run can be
+// resumed without rereading what it already hashed.
+//
+// Each line records a path with the size, mtime and digest kind it was
+// hashed at. Records are collected in memory and written and fsync'ed by a
+// background thread every `sync_interval`, so a crash loses at most that
+// much work. A torn last line is dropped when the journal is reopened.
+class Journal {
+public:
+    using Digest = std::array<unsigned char, 32>;
+
+    struct Entry {
+        uint64_t size;
+        int64_t mtime_ns;
+        uint64_t kind;  // as HashCache::Key::kind
+        Digest digest;
+    };
+
+    Journal() = default;
+    ~Journal();
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    // Load the records in `path` (creating it if missing) and start
+    // appending to it. Returns false and sets `error` if the file cannot be
+    // opened or is not a journal.
+    bool open(const std::filesystem::path& path, std::chrono::milliseconds sync_interval, std::string& error);
+
+    // The last record for `path` from earlier runs, or null. Safe to call
+    // concurrently with append().
+    const Entry* find(const std::filesystem::path& path) const;
+
+    // Record a finished file. Thread-safe; never waits for the disk.
+    void append(const std::filesystem::path& path, const Entry& entry);
+
+    // Write and fsync what is left, then close. Returns false if any write
+    // failed along the way.
+    bool close();
+
+    size_t loaded() const { return records_.size(); }
+    size_t appended() const { return appended_; }
+
+private:
+    bool load(const std::filesystem::path& path, std::string& error);
+    void run();
+    bool flush(const std::string& text);
+
+    std::unordered_map<std::string, Entry> records_;
+
+    std::FILE* file_ = nullptr;
+    std::chrono::milliseconds sync_interval_{1000};
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::string pending_;
+    bool closing_ = false;
+    bool failed_ = false;
+    std::atomic<size_t> appended_{0};
+    std::thread thread_;
+};
+
+#endif // JOURNAL_H
@@ -0,0 +1,40 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+// Author: Hossein Taji
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A list of expected digests, read from either this tool's report format
+// ("path: hash") or sha256sum's ("hash  path", "hash *path"). Entries are
+// indexed by normalised path so a tree walk can look files up directly.
+class Manifest {
+public:
+    struct Entry {
+        std::string path;      // as written in the manifest
+        std::string expected;  // digest with lower-case hex, including any tree-hash label
+    };
+
+    // Returns false and sets `error` if the file cannot be read or a line
+    // is in neither format.
+    bool load(const std::filesystem::path& file, std::string& error);
+
+    const std::vector<Entry>& entries() const { return entries_; }
+
+    // Index of the entry for `path`, or npos. Safe to call concurrently.
+    size_t find(const std::filesystem::path& path) const;
+
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+private:
+    static std::string key(const std::filesystem::path& path);
+
+    std::vector<Entry> entries_;
+    std::unordered_map<std::string, size_t> index_;
+};
+
+#endif // MANIFEST_H
@@ -0,0 +1,72 @@
+#ifndef METRICS_EXPORTER_H
+#define METRICS_EXPORTER_H
+
+// Author: Hossein Taji
+
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Publishes live counters in the Prometheus text exposition format, for
+// monitoring long runs. Metrics are sampled from callbacks, normally reading
+// the atomic counters the workers already maintain, so exporting adds no
+// work to the hashing path. Two outlets, either or both:
+//  - a file for node_exporter's textfile collector, rewritten atomically
+//    (temporary file and rename) every interval and once more at stop();
+//  - a plain HTTP endpoint on 127.0.0.1 (POSIX only), sampled per scrape.
+class MetricsExporter {
+public:
+    enum class Type { counter, gauge };
+    using Sample = std::function<double()>;
+
+    MetricsExporter() = default;
+    ~MetricsExporter();
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    // Register a metric. Call before start(); `sample` is called from the
+    // exporter's threads.
+    void add(std::string name, std::string help, Type type, Sample sample);
+
+    // Start exporting to `textfile` (if not empty) and on `port` (if not 0).
+    // Returns false and sets `error` if the port cannot be opened.
+    bool start(const std::filesystem::path& textfile, int port, std::chrono::seconds interval, std::string& error);
+
+    // Write the final values and stop. Idempotent.
+    void stop();
+
+    // The current values, in the text exposition format.
+    std::string render() const;
+
+private:
+    struct Metric {
+        std::string name;
+        std::string help;
+        Type type;
+        Sample sample;
+    };
+
+    bool write_textfile() const;
+    void run_textfile();
+    void run_http();
+
+    std::vector<Metric> metrics_;
+    std::filesystem::path textfile_;
+    std::chrono::seconds interval_{15};
+    int listen_fd_ = -1;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool started_ = false;
+    bool stopping_ = false;
+    std::thread textfile_thread_;
+    std::thread http_thread_;
+};
+
+#endif // METRICS_EXPORTER_H
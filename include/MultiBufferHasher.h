@@ -0,0 +1,47 @@
+#ifndef MULTI_BUFFER_HASHER_H
+#define MULTI_BUFFER_HASHER_H
+
+// Author: Hossein Taji
+
+#include <array>
+#include <cstddef>
+
+// Hashes several independent in-memory messages at once by keeping one
+// SHA-256 state per SIMD lane (8 lanes with AVX2, 16 with AVX-512). Lanes
+// advance in lockstep, one 64-byte block per step, so it pays off for many
+// small messages of similar length.
+class MultiBufferHasher {
+public:
+    enum class Impl { none, avx2, avx512 };
+
+    using Digest = std::array<unsigned char, 32>;
+
+    static constexpr size_t kMaxLanes = 16;
+
+    // A message to hash. The data must stay valid for the duration of hash().
+    struct Message {
+        const unsigned char* data;
+        size_t size;
+    };
+
+    // Best implementation supported by this CPU.
+    static Impl detect();
+    static bool supported(Impl impl);
+    static const char* name(Impl impl);
+
+    explicit MultiBufferHasher(Impl impl = detect());
+
+    Impl impl() const { return impl_; }
+
+    // Number of messages hashed per step; 1 when no SIMD engine is available.
+    size_t lanes() const;
+
+    // Hash `count` messages and write one digest each. Up to lanes() are
+    // hashed together; more are split into groups of lanes().
+    void hash(const Message* messages, size_t count, Digest* digests) const;
+
+private:
+    Impl impl_;
+};
+
+#endif // MULTI_BUFFER_HASHER_H
@@ -0,0 +1,70 @@
+#ifndef PROGRESS_RENDERER_H
+#define PROGRESS_RENDERER_H
+
+// Author: Hossein Taji
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+// Draws the progress line from its own thread. Workers only bump atomic
+// counters; the renderer samples them at a fixed rate and writes the whole
+// line with a single write, showing files/s, MB/s and an ETA. It does
+// nothing when stdout is not a terminal.
+class ProgressRenderer {
+public:
+    // The counters to sample; they must outlive the renderer.
+    struct Counters {
+        const std::atomic<int>& processed_files;
+        const std::atomic<int>& discovered_files;
+        const std::atomic<uint64_t>& processed_bytes;
+        const std::atomic<bool>& discovery_complete;
+    };
+
+    static constexpr std::chrono::milliseconds kDefaultInterval{100};
+
+    static bool stdout_is_terminal();
+
+    // Starts rendering right away if stdout is a terminal. `output_mutex`
+    // is held while writing so other console output does not interleave.
+    ProgressRenderer(Counters counters, std::mutex& output_mutex,
+                     std::chrono::milliseconds interval = kDefaultInterval);
+    ~ProgressRenderer();
+
+    ProgressRenderer(const ProgressRenderer&) = delete;
+    ProgressRenderer& operator=(const ProgressRenderer&) = delete;
+
+    bool enabled() const { return enabled_; }
+
+    // Draw the final state, end the line and stop the thread. Idempotent.
+    void stop();
+
+private:
+    void run();
+    void render(bool final);
+
+    Counters counters_;
+    std::mutex& output_mutex_;
+    std::chrono::milliseconds interval_;
+    bool enabled_;
+
+    std::chrono::steady_clock::time_point start_;
+    std::chrono::steady_clock::time_point last_sample_;
+    int last_files_ = 0;
+    uint64_t last_bytes_ = 0;
+    double files_rate_ = 0;  // smoothed, per second
+    double bytes_rate_ = 0;
+    size_t last_length_ = 0;
+    bool drawn_ = false;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread thread_;
+};
+
+#endif // PROGRESS_RENDERER_H
@@ -0,0 +1,61 @@
+#ifndef REPORT_WRITER_H
+#define REPORT_WRITER_H
+
+// Author: Hossein Taji
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Appends report text to a file from a background thread while hashing
+// continues. Callers hand over large batches of complete lines; each batch
+// becomes one write. At most `max_pending` batches wait in memory, after
+// which callers block, so memory stays bounded however many files there
+// are. Optionally the file is fsync'ed periodically so a crash loses at most
+// that interval's worth of results.
+class ReportWriter {
+public:
+    static constexpr size_t kDefaultMaxPending = 64;
+
+    ReportWriter() = default;
+    ~ReportWriter();
+
+    ReportWriter(const ReportWriter&) = delete;
+    ReportWriter& operator=(const ReportWriter&) = delete;
+
+    // Create (truncate) `path` and start the writer thread. A zero
+    // `sync_interval` never fsyncs before close().
+    bool open(const std::filesystem::path& path, std::chrono::seconds sync_interval,
+              size_t max_pending = kDefaultMaxPending);
+
+    // Queue a batch of lines. Thread-safe; blocks while the queue is full.
+    void write(std::string batch);
+
+    // Write everything queued, fsync and close. Returns false if any write
+    // failed along the way.
+    bool close();
+
+private:
+    void run();
+    bool sync();
+
+    std::FILE* file_ = nullptr;
+    std::chrono::seconds sync_interval_{0};
+    size_t max_pending_ = kDefaultMaxPending;
+
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::deque<std::string> pending_;
+    bool closing_ = false;
+    bool failed_ = false;
+    std::thread thread_;
+};
+
+#endif // REPORT_WRITER_H
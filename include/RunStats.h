@@ -0,0 +1,59 @@
+#ifndef RUN_STATS_H
+#define RUN_STATS_H
+
+// Author: Hossein Taji
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "ThreadPool.h"
+
+// Per-file timings for --stats. Each thread records into its own counters
+// without locking; print() merges them into a report of phase times,
+// aggregate and per-thread throughput, pool worker utilisation, and queue
+// wait and latency by file size, enough to tell whether a run was limited
+// by I/O, by hashing or by scheduling.
+class RunStats {
+public:
+    // Size classes: < 4 KB, < 64 KB, < 1 MB, < 16 MB, < 256 MB, larger.
+    static constexpr size_t kSizeClasses = 6;
+    // Latency buckets: < 100 us, < 1 ms, < 10 ms, < 100 ms, < 1 s, < 10 s, longer.
+    static constexpr size_t kLatencyBuckets = 7;
+
+    // Wall times in seconds. Hashing starts with discovery and overlaps it.
+    struct Phases {
+        double discovery;
+        double hashing;
+        double report;
+    };
+
+    // Record a finished file of `size` bytes on the calling thread: handed
+    // to the pool at `queued_ns`, started at `start_ns`, done at `end_ns`
+    // (steady clock). Thread-safe.
+    void record(uint64_t size, int64_t queued_ns, int64_t start_ns, int64_t end_ns);
+
+    // Write the report. No file may be recorded meanwhile.
+    void print(std::ostream& out, const Phases& phases, uint64_t bytes_read,
+               const std::vector<ThreadPool::WorkerStats>& workers) const;
+
+private:
+    struct Thread {
+        uint64_t files = 0;
+        uint64_t bytes = 0;
+        uint64_t class_files[kSizeClasses] = {};
+        uint64_t latency_counts[kSizeClasses][kLatencyBuckets] = {};
+        int64_t latency_ns[kSizeClasses] = {};
+        int64_t wait_ns[kSizeClasses] = {};
+    };
+
+    Thread& this_thread();
+
+    mutable std::mutex mutex_;  // guards registration of threads_
+    std::vector<std::unique_ptr<Thread>> threads_;
+};
+
+#endif // RUN_STATS_H
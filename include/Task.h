@@ -0,0 +1,100 @@
+#ifndef TASK_H
+#define TASK_H
+
+// Author: Hossein Taji
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// A move-only `void()` callable with a large inline buffer. Unlike
+// std::function (16 bytes of inline space in libstdc++), a lambda capturing
+// a std::filesystem::path or a couple of shared_ptrs fits without a heap
+// allocation. Larger callables still work; they are stored on the heap.
+class Task {
+public:
+    static constexpr size_t kInlineSize = 64;
+
+    Task() noexcept = default;
+    Task(std::nullptr_t) noexcept {}
+
+    template <typename F, typename = typename std::enable_if<
+                              !std::is_same<typename std::decay<F>::type, Task>::value &&
+                              !std::is_same<typename std::decay<F>::type, std::nullptr_t>::value>::type>
+    Task(F&& f) {
+        using Callable = typename std::decay<F>::type;
+        if constexpr (sizeof(Callable) <= kInlineSize && alignof(Callable) <= alignof(std::max_align_t) &&
+                      std::is_nothrow_move_constructible<Callable>::value) {
+            new (storage_) Callable(std::forward<F>(f));
+            ops_ = &inline_ops<Callable>;
+        } else {
+            *reinterpret_cast<Callable**>(storage_) = new Callable(std::forward<F>(f));
+            ops_ = &heap_ops<Callable>;
+        }
+    }
+
+    Task(Task&& other) noexcept { take(other); }
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+
+    Task& operator=(std::nullptr_t) noexcept {
+        reset();
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() { reset(); }
+
+    explicit operator bool() const noexcept { return ops_ != nullptr; }
+
+    void operator()() { ops_->invoke(storage_); }
+
+private:
+    struct Ops {
+        void (*invoke)(void* storage);
+        void (*move)(void* to, void* from) noexcept;  // leaves `from` destroyed
+        void (*destroy)(void* storage) noexcept;
+    };
+
+    template <typename Callable>
+    static constexpr Ops inline_ops = {
+        [](void* storage) { (*static_cast<Callable*>(storage))(); },
+        [](void* to, void* from) noexcept {
+            new (to) Callable(std::move(*static_cast<Callable*>(from)));
+            static_cast<Callable*>(from)->~Callable();
+        },
+        [](void* storage) noexcept { static_cast<Callable*>(storage)->~Callable(); },
+    };
+
+    template <typename Callable>
+    static constexpr Ops heap_ops = {
+        [](void* storage) { (**static_cast<Callable**>(storage))(); },
+        [](void* to, void* from) noexcept { *static_cast<Callable**>(to) = *static_cast<Callable**>(from); },
+        [](void* storage) noexcept { delete *static_cast<Callable**>(storage); },
+    };
+
+    void take(Task& other) noexcept {
+        ops_ = other.ops_;
+        if (ops_) ops_->move(storage_, other.storage_);
+        other.ops_ = nullptr;
+    }
+
+    void reset() noexcept {
+        if (ops_) ops_->destroy(storage_);
+        ops_ = nullptr;
+    }
+
+    alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+    const Ops* ops_ = nullptr;
+};
+
+#endif // TASK_H
@@ -4,34 +4,146 @@
 // Author: Hossein Taji
 
 #include <vector>
-#include <queue>
 #include <thread>
+#include <atomic>
+#include <memory>
 #include <mutex>
-#include <condition_variable>
-#include <functional>
+#include <cstddef>
+#include <cstdint>
 
+#include "EventCount.h"
+#include "MpmcQueue.h"
+#include "Task.h"
+#include "WorkStealingDeque.h"
+
+// Work-stealing thread pool. Tasks submitted from outside go through a shared
+// lock-free injection queue; tasks spawned by a worker go onto that worker's
+// own deque, where they stay local and cache-hot. Idle workers steal from a
+// random victim before going to sleep. Tasks are stored inline (see Task.h)
+// and spawned tasks reuse per-thread nodes, so submitting work does not
+// allocate once the pool is warm.
 class ThreadPool {
 public:
-    // Constructor to create and launch worker threads.
-    ThreadPool(size_t num_threads);
+    static constexpr size_t kDefaultQueueCapacity = 1 << 16;
+
+    // What one worker did over its lifetime. Idle time is spent looking for
+    // work or asleep waiting for it.
+    struct WorkerStats {
+        uint64_t tasks = 0;
+        uint64_t steals = 0;
+        int64_t busy_ns = 0;
+        int64_t idle_ns = 0;
+    };
+
+    // Constructor to create and launch worker threads. With `stats`, it is
+    // resized to one entry per worker, each filled in as its worker exits
+    // (so it is complete once the pool is destroyed).
+    ThreadPool(size_t num_threads, size_t queue_capacity = kDefaultQueueCapacity,
+               std::vector<WorkerStats>* stats = nullptr);
 
     // Destructor to join all threads.
     ~ThreadPool();
 
-    // Add a new task to the execution queue.
-    void enqueue(std::function<void()> task);
+    // Run every queued task, including tasks they add, then join the
+    // workers. The destructor does this too; calling it first lets the
+    // caller keep using the pool's gauges while it drains. Not from a worker.
+    void shutdown();
+
+    // Gauges for monitoring; approximate while the pool is busy.
+    size_t queued_tasks() const;
+    size_t active_workers() const;
+    size_t size() const { return workers.size(); }
+
+    // Add a new task to the shared queue. When the queue is full, external
+    // callers wait for room; a worker thread runs the task itself instead, so
+    // tasks that enqueue more tasks can never deadlock the pool.
+    void enqueue(Task task);
+
+    // Add a task to the priority queue, which workers serve before the
+    // shared queue: the waiting task with the highest priority runs first,
+    // ties in submission order.
+    void enqueue(Task task, uint64_t priority);
+
+    // Add a task from inside a running task: it goes onto the calling
+    // worker's own deque (newest first). Falls back to enqueue() when called
+    // from a thread that is not one of this pool's workers.
+    void spawn(Task task);
+
+    // Run fn(i) for every i in [begin, end), typically indices into an array
+    // the caller keeps alive. Submits a single task that splits its range in
+    // half on demand: one half is spawned (and can be stolen), the other is
+    // kept, so a million items cost no million allocations and idle workers
+    // still pick up the work. `fn` is copied into each split and should be
+    // cheap to copy.
+    template <typename F>
+    void enqueue_range(size_t begin, size_t end, F fn);
 
 private:
+    template <typename F>
+    struct RangeTask {
+        ThreadPool* pool;
+        size_t begin;
+        size_t end;
+        F fn;
+
+        void operator()() {
+            while (end - begin > 1) {
+                size_t middle = begin + (end - begin) / 2;
+                pool->spawn(RangeTask{pool, middle, end, fn});
+                end = middle;
+            }
+            fn(begin);
+        }
+    };
+
     // The main function for each worker thread.
-    void worker();
+    void worker(size_t index);
+
+    struct PrioritizedTask {
+        uint64_t priority;
+        uint64_t sequence;
+        Task task;
+
+        // Heap order: higher priority first, then earlier submission.
+        bool operator<(const PrioritizedTask& other) const {
+            return priority != other.priority ? priority < other.priority : sequence > other.sequence;
+        }
+    };
+
+    // Find work: own deque, then the priority queue, then the shared queue,
+    // then other workers' deques.
+    bool find_task(size_t index, Task& task);
+    bool pop_prioritized(Task& task);
+    bool steal(size_t thief, Task& task);
 
     std::vector<std::thread> workers;
-    std::queue<std::function<void()>> tasks;
+    std::vector<std::unique_ptr<WorkStealingDeque<Task*>>> local_tasks;
+    MpmcQueue<Task> tasks;
+
+    // Binary heap behind a mutex; prioritized_count lets workers skip the lock
+    // while it is empty, which is the common case.
+    std::mutex prioritized_mutex;
+    std::vector<PrioritizedTask> prioritized;
+    uint64_t prioritized_sequence = 0;
+    std::atomic<size_t> prioritized_count{0};
 
-    // Synchronization primitives
-    std::mutex queue_mutex;
-    std::condition_variable condition;
-    bool stop;
+    // Idle workers park on not_empty; producers facing a full queue park on not_full.
+    EventCount not_empty;
+    EventCount not_full;
+    std::atomic<bool> stop;
+    std::vector<WorkerStats>* stats;
+
+    // Set by each worker while it runs a task, one cache line each.
+    struct alignas(64) BusyFlag {
+        std::atomic<bool> busy{false};
+    };
+    std::unique_ptr<BusyFlag[]> busy;
 };
 
+template <typename F>
+void ThreadPool::enqueue_range(size_t begin, size_t end, F fn) {
+    if (begin >= end) return;
+    spawn(RangeTask<F>{this, begin, end, std::move(fn)});
+}
+
 #endif // THREAD_POOL_H
@@ -0,0 +1,64 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Author: Hossein Taji
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+// Timeline of what every thread was doing, written in the Chrome trace-event
+// format (load it in Perfetto or chrome://tracing).
+//
+// Each thread records complete spans into its own fixed-size ring buffer:
+// recording takes no lock and allocates nothing, and when a buffer is full
+// the oldest spans are overwritten. While tracing is off a span costs one
+// relaxed load.
+class Trace {
+public:
+    static constexpr size_t kEventsPerThread = 1 << 18;
+
+    // Start recording. Must be called before the threads to be traced run.
+    static void start();
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    // Steady clock, in ns.
+    static int64_t now();
+
+    // Record a span on the calling thread. `name` must be a string literal
+    // (it is stored by pointer); `bytes` is shown as an argument unless negative.
+    static void record(const char* name, int64_t start_ns, int64_t end_ns, int64_t bytes = -1);
+
+    // Label the calling thread in the timeline.
+    static void name_thread(const std::string& name);
+
+    // Write everything recorded. No thread may be recording meanwhile.
+    static bool write(const std::filesystem::path& path, std::string& error);
+
+    // Records the enclosing scope as a span.
+    class Span {
+    public:
+        explicit Span(const char* name, int64_t bytes = -1)
+            : name_(enabled() ? name : nullptr), start_(name_ ? now() : 0), bytes_(bytes) {}
+        ~Span() {
+            if (name_) record(name_, start_, now(), bytes_);
+        }
+
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+        void set_bytes(int64_t bytes) { bytes_ = bytes; }
+
+    private:
+        const char* name_;
+        int64_t start_;
+        int64_t bytes_;
+    };
+
+private:
+    static std::atomic<bool> enabled_;
+};
+
+#endif // TRACE_H
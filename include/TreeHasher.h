@@ -0,0 +1,65 @@
+#ifndef TREE_HASHER_H
+#define TREE_HASHER_H
+
+// Author: Hossein Taji
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "ThreadPool.h"
+
+// Hashes a file as a Merkle tree so one large file can use every core.
+// The file is split into fixed-size chunks that are hashed as independent
+// pool tasks, and the chunk digests are combined as in RFC 6962:
+//
+//   leaf  = SHA-256(0x00 || chunk)
+//   node  = SHA-256(0x01 || left || right), splitting n leaves at the
+//           largest power of two below n
+//   empty = SHA-256("")
+//
+// The result depends on the chunk size and is NOT the file's SHA-256; it is
+// always reported with label(), e.g. "sha256-tree-4M". Instances are cheap
+// to copy.
+class TreeHasher {
+public:
+    using Digest = std::array<unsigned char, 32>;
+
+    // Called once per file, on the worker that finishes its last chunk.
+    // `ok` is false if the file could not be read; `size` is its length.
+    using DoneCallback = std::function<void(bool ok, const Digest& root, uint64_t size)>;
+
+    static constexpr uint64_t kDefaultChunkSize = 4 << 20;  // 4 MiB
+
+    // `hashed_bytes`, if given, is advanced as each chunk is hashed.
+    explicit TreeHasher(ThreadPool& pool, uint64_t chunk_size = kDefaultChunkSize,
+                        std::atomic<uint64_t>* hashed_bytes = nullptr);
+
+    // Start hashing `path` and return. Single-chunk files are hashed on the
+    // calling thread before this returns.
+    void hash(const std::filesystem::path& path, DoneCallback on_done) const;
+
+    uint64_t chunk_size() const { return chunk_size_; }
+
+    // Name of the digest for a chunk size, e.g. "sha256-tree-4M".
+    static std::string label(uint64_t chunk_size);
+
+    // Root of the tree over `count` leaf digests.
+    static Digest root(const Digest* leaves, size_t count);
+
+private:
+    struct File;
+
+    static bool hash_chunk(const File& file, size_t index, Digest& digest);
+
+    ThreadPool& pool_;
+    uint64_t chunk_size_;
+    std::atomic<uint64_t>* hashed_bytes_;
+};
+
+#endif // TREE_HASHER_H
@@ -0,0 +1,115 @@
+#ifndef WORK_STEALING_DEQUE_H
+#define WORK_STEALING_DEQUE_H
+
+// Author: Hossein Taji
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// Chase-Lev work-stealing deque (with the memory orderings from Le et al.,
+// "Correct and Efficient Work-Stealing for Weak Memory Models", PPoPP 2013).
+// The owning thread pushes and pops at the bottom without any atomic
+// read-modify-write in the common case; other threads steal from the top.
+// The ring grows on demand; retired rings are kept until destruction because
+// a thief may still be reading one.
+template <typename T>
+class WorkStealingDeque {
+    static_assert(std::is_trivially_copyable<T>::value, "elements are read racily by thieves");
+
+public:
+    explicit WorkStealingDeque(size_t capacity = 256) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        rings_.emplace_back(new Ring(size));
+        ring_.store(rings_.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // Owner only.
+    void push(T value) {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        int64_t top = top_.load(std::memory_order_acquire);
+        Ring* ring = ring_.load(std::memory_order_relaxed);
+        if (bottom - top > static_cast<int64_t>(ring->mask)) ring = grow(ring, top, bottom);
+        ring->put(bottom, value);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    // Owner only. Takes the most recently pushed element.
+    bool pop(T& value) {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        Ring* ring = ring_.load(std::memory_order_relaxed);
+        bottom_.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = top_.load(std::memory_order_relaxed);
+
+        if (top > bottom) {
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return false;
+        }
+        value = ring->get(bottom);
+        if (top == bottom) {
+            // Last element: race any thief for it.
+            bool won = top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                                    std::memory_order_relaxed);
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // Any thread. Takes the oldest element; fails if empty or if another
+    // thread won the race for it.
+    bool steal(T& value) {
+        int64_t top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = bottom_.load(std::memory_order_acquire);
+        if (top >= bottom) return false;
+        Ring* ring = ring_.load(std::memory_order_acquire);
+        value = ring->get(top);
+        return top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                            std::memory_order_relaxed);
+    }
+
+    bool empty() const {
+        return top_.load(std::memory_order_relaxed) >= bottom_.load(std::memory_order_relaxed);
+    }
+
+    // Approximate number of elements; exact only when quiescent.
+    size_t size_approx() const {
+        int64_t top = top_.load(std::memory_order_relaxed);
+        int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        return bottom > top ? static_cast<size_t>(bottom - top) : 0;
+    }
+
+private:
+    struct Ring {
+        size_t mask;
+        std::unique_ptr<std::atomic<T>[]> slots;
+
+        explicit Ring(size_t size) : mask(size - 1), slots(new std::atomic<T>[size]) {}
+        void put(int64_t index, T value) { slots[index & mask].store(value, std::memory_order_relaxed); }
+        T get(int64_t index) const { return slots[index & mask].load(std::memory_order_relaxed); }
+    };
+
+    Ring* grow(Ring* old, int64_t top, int64_t bottom) {
+        rings_.emplace_back(new Ring((old->mask + 1) * 2));
+        Ring* ring = rings_.back().get();
+        for (int64_t i = top; i < bottom; ++i) ring->put(i, old->get(i));
+        ring_.store(ring, std::memory_order_release);
+        return ring;
+    }
+
+    alignas(64) std::atomic<int64_t> top_{0};
+    alignas(64) std::atomic<int64_t> bottom_{0};
+    std::atomic<Ring*> ring_;
+    std::vector<std::unique_ptr<Ring>> rings_;  // owner only
+};
+
+#endif // WORK_STEALING_DEQUE_H
@@ -30,12 +30,31 @@ THE SOFTWARE.
     1048576  //=1024*1024: default is 1MB memory
 #endif
 
+#if !defined(PICOSHA2_NO_SHANI) && \
+    (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+#define PICOSHA2_HAVE_SHANI 1
+#endif
+
 #include <algorithm>
 #include <cassert>
+#include <cstdint>
 #include <iterator>
 #include <sstream>
+#include <type_traits>
 #include <vector>
 #include <fstream>
+
+#ifdef PICOSHA2_HAVE_SHANI
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define PICOSHA2_TARGET_SHANI
+#else
+#include <cpuid.h>
+#define PICOSHA2_TARGET_SHANI __attribute__((target("sha,sse4.1,ssse3")))
+#endif
+#endif
+
 namespace picosha2 {
 typedef unsigned long word_t;
 typedef unsigned char byte_t;
@@ -139,8 +158,184 @@ void hash256_block(RaIter1 message_digest, RaIter2 first, RaIter2 last) {
     }
 }
 
+// Compresses `blocks` consecutive 64-byte blocks starting at `data`.
+typedef void (*block_fn_t)(word_t* message_digest, const byte_t* data,
+                           std::size_t blocks);
+
+inline void hash256_blocks_scalar(word_t* message_digest, const byte_t* data,
+                                  std::size_t blocks) {
+    for (; blocks != 0; --blocks, data += 64) {
+        hash256_block(message_digest, data, data + 64);
+    }
+}
+
+#ifdef PICOSHA2_HAVE_SHANI
+inline bool cpu_has_shani() {
+    unsigned int leaf1[4] = {0, 0, 0, 0};
+    unsigned int leaf7[4] = {0, 0, 0, 0};
+#if defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7) return false;
+    __cpuid(regs, 1);
+    std::copy(regs, regs + 4, leaf1);
+    __cpuidex(regs, 7, 0);
+    std::copy(regs, regs + 4, leaf7);
+#else
+    if (__get_cpuid_max(0, 0) < 7) return false;
+    __get_cpuid(1, &leaf1[0], &leaf1[1], &leaf1[2], &leaf1[3]);
+    __get_cpuid_count(7, 0, &leaf7[0], &leaf7[1], &leaf7[2], &leaf7[3]);
+#endif
+    const bool ssse3 = (leaf1[2] >> 9) & 1;
+    const bool sse41 = (leaf1[2] >> 19) & 1;
+    const bool sha = (leaf7[1] >> 29) & 1;
+    return ssse3 && sse41 && sha;
+}
+
+// Round constants as packed 32-bit lanes for the SHA-NI kernel.
+struct add_constant_x4 {
+    __m128i v[16];
+    PICOSHA2_TARGET_SHANI add_constant_x4() {
+        for (std::size_t i = 0; i < 16; ++i) {
+            v[i] = _mm_set_epi32(static_cast<int>(add_constant[i * 4 + 3]),
+                                 static_cast<int>(add_constant[i * 4 + 2]),
+                                 static_cast<int>(add_constant[i * 4 + 1]),
+                                 static_cast<int>(add_constant[i * 4]));
+        }
+    }
+};
+
+// SHA-256 compression using the x86 SHA extensions (sha256rnds2,
+// sha256msg1, sha256msg2). Each loop iteration performs four rounds and
+// extends the message schedule by four words.
+PICOSHA2_TARGET_SHANI
+inline void hash256_blocks_shani(word_t* message_digest, const byte_t* data,
+                                 std::size_t blocks) {
+    static const add_constant_x4 k;
+    const __m128i byte_swap =
+        _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // Rearrange A..H into the ABEF / CDGH register layout the instructions use.
+    __m128i state0 = _mm_set_epi32(static_cast<int>(message_digest[0]),
+                                   static_cast<int>(message_digest[1]),
+                                   static_cast<int>(message_digest[4]),
+                                   static_cast<int>(message_digest[5]));
+    __m128i state1 = _mm_set_epi32(static_cast<int>(message_digest[2]),
+                                   static_cast<int>(message_digest[3]),
+                                   static_cast<int>(message_digest[6]),
+                                   static_cast<int>(message_digest[7]));
+
+    for (; blocks != 0; --blocks, data += 64) {
+        const __m128i abef_save = state0;
+        const __m128i cdgh_save = state1;
+
+        __m128i msg[4];
+        for (std::size_t i = 0; i < 4; ++i) {
+            msg[i] = _mm_shuffle_epi8(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * 16)),
+                byte_swap);
+        }
+
+        for (std::size_t i = 0; i < 16; ++i) {
+            __m128i wk = _mm_add_epi32(msg[i & 3], k.v[i]);
+            state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+            if (i < 12) {
+                __m128i next = _mm_sha256msg1_epu32(msg[i & 3], msg[(i + 1) & 3]);
+                next = _mm_add_epi32(
+                    next, _mm_alignr_epi8(msg[(i + 3) & 3], msg[(i + 2) & 3], 4));
+                msg[i & 3] = _mm_sha256msg2_epu32(next, msg[(i + 3) & 3]);
+            }
+            wk = _mm_shuffle_epi32(wk, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+        }
+
+        state0 = _mm_add_epi32(state0, abef_save);
+        state1 = _mm_add_epi32(state1, cdgh_save);
+    }
+
+    alignas(16) std::uint32_t abef[4];
+    alignas(16) std::uint32_t cdgh[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(abef), state0);
+    _mm_store_si128(reinterpret_cast<__m128i*>(cdgh), state1);
+    message_digest[0] = abef[3];
+    message_digest[1] = abef[2];
+    message_digest[2] = cdgh[3];
+    message_digest[3] = cdgh[2];
+    message_digest[4] = abef[1];
+    message_digest[5] = abef[0];
+    message_digest[6] = cdgh[1];
+    message_digest[7] = cdgh[0];
+}
+#endif  // PICOSHA2_HAVE_SHANI
+
+template <typename T>
+struct is_byte_pointer
+    : std::integral_constant<
+          bool, std::is_pointer<T>::value &&
+                    std::is_integral<typename std::remove_cv<
+                        typename std::remove_pointer<T>::type>::type>::value &&
+                    sizeof(typename std::remove_pointer<T>::type) == 1> {};
+
+}  // namespace detail
+
+// Compression kernels that can back hash256_one_by_one.
+enum class block_impl { scalar, shani };
+
+inline const char* block_impl_name(block_impl impl) {
+    return impl == block_impl::shani ? "shani" : "scalar";
+}
+
+inline bool block_impl_supported(block_impl impl) {
+    switch (impl) {
+        case block_impl::scalar:
+            return true;
+        case block_impl::shani:
+#ifdef PICOSHA2_HAVE_SHANI
+            return detail::cpu_has_shani();
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+inline detail::block_fn_t block_impl_function(block_impl impl) {
+#ifdef PICOSHA2_HAVE_SHANI
+    if (impl == block_impl::shani) return detail::hash256_blocks_shani;
+#endif
+    static_cast<void>(impl);
+    return detail::hash256_blocks_scalar;
+}
+
+namespace detail {
+struct active_block_impl {
+    block_impl impl;
+    block_fn_t fn;
+};
+
+// The kernel is chosen once, on first use, from the CPU's capabilities.
+inline active_block_impl& active_block() {
+    static active_block_impl active = [] {
+        block_impl best = block_impl_supported(block_impl::shani)
+                              ? block_impl::shani
+                              : block_impl::scalar;
+        return active_block_impl{best, block_impl_function(best)};
+    }();
+    return active;
+}
 }  // namespace detail
 
+inline block_impl current_block_impl() { return detail::active_block().impl; }
+
+// Override the automatically selected kernel. Intended to be called once at
+// startup before any hashing begins. Returns false if `impl` is not
+// supported on this CPU, in which case the selection is left unchanged.
+inline bool set_block_impl(block_impl impl) {
+    if (!block_impl_supported(impl)) return false;
+    detail::active_block() = detail::active_block_impl{impl, block_impl_function(impl)};
+    return true;
+}
+
 template <typename InIter>
 void output_hex(InIter first, InIter last, std::ostream& os) {
     os.setf(std::ios::hex, std::ios::basefield);
@@ -184,29 +379,46 @@ class hash256_one_by_one {
     hash256_one_by_one() { init(); }
 
     void init() {
-        buffer_.clear();
+        buffer_size_ = 0;
         std::fill(data_length_digits_, data_length_digits_ + 4, word_t(0));
         std::copy(detail::initial_message_digest,
                   detail::initial_message_digest + 8, h_);
     }
 
+    // Only a partial trailing block is ever copied into the object; whole
+    // 64-byte blocks are compressed directly from the caller's range.
     template <typename RaIter>
     void process(RaIter first, RaIter last) {
-        add_to_data_length(static_cast<word_t>(std::distance(first, last)));
-        std::copy(first, last, std::back_inserter(buffer_));
-        std::size_t i = 0;
-        for (; i + 64 <= buffer_.size(); i += 64) {
-            detail::hash256_block(h_, buffer_.begin() + i,
-                                  buffer_.begin() + i + 64);
+        std::size_t length = static_cast<std::size_t>(std::distance(first, last));
+        add_to_data_length(static_cast<word_t>(length));
+
+        if (buffer_size_ != 0) {
+            std::size_t take = std::min<std::size_t>(64 - buffer_size_, length);
+            std::copy(first, first + take, buffer_ + buffer_size_);
+            buffer_size_ += take;
+            first += take;
+            length -= take;
+            if (buffer_size_ < 64) {
+                return;
+            }
+            compress(buffer_, 1);
+            buffer_size_ = 0;
         }
-        buffer_.erase(buffer_.begin(), buffer_.begin() + i);
+
+        std::size_t blocks = length / 64;
+        compress(first, blocks);
+        first += blocks * 64;
+        length -= blocks * 64;
+
+        std::copy(first, first + length, buffer_);
+        buffer_size_ = length;
     }
 
     void finish() {
         byte_t temp[64];
         std::fill(temp, temp + 64, byte_t(0));
-        std::size_t remains = buffer_.size();
-        std::copy(buffer_.begin(), buffer_.end(), temp);
+        std::size_t remains = buffer_size_;
+        std::copy(buffer_, buffer_ + buffer_size_, temp);
         assert(remains < 64);
 
         // This branch is not executed actually (`remains` is always lower than 64),
@@ -222,14 +434,14 @@ class hash256_one_by_one {
 
         if (remains > 55) {
             std::fill(temp + remains + 1, temp + 64, byte_t(0));
-            detail::hash256_block(h_, temp, temp + 64);
+            compress(temp, 1);
             std::fill(temp, temp + 64 - 4, byte_t(0));
         } else {
             std::fill(temp + remains + 1, temp + 64 - 4, byte_t(0));
         }
 
         write_data_bit_length(&(temp[56]));
-        detail::hash256_block(h_, temp, temp + 64);
+        compress(temp, 1);
     }
 
     template <typename OutIter>
@@ -243,6 +455,21 @@ class hash256_one_by_one {
     }
 
    private:
+    // Contiguous byte ranges go through the runtime-selected kernel; any
+    // other iterator type uses the portable template implementation.
+    template <typename RaIter>
+    void compress(RaIter first, std::size_t blocks) {
+        if (blocks == 0) return;
+        if constexpr (detail::is_byte_pointer<RaIter>::value) {
+            detail::active_block().fn(
+                h_, reinterpret_cast<const byte_t*>(first), blocks);
+        } else {
+            for (; blocks != 0; --blocks, first += 64) {
+                detail::hash256_block(h_, first, first + 64);
+            }
+        }
+    }
+
     void add_to_data_length(word_t n) {
         word_t carry = 0;
         data_length_digits_[0] += n;
@@ -277,7 +504,8 @@ class hash256_one_by_one {
             (*begin++) = static_cast<byte_t>(data_bit_length_digits[i]);
         }
     }
-    std::vector<byte_t> buffer_;
+    byte_t buffer_[64];        // partial block carried between process() calls
+    std::size_t buffer_size_;
     word_t data_length_digits_[4];  // as 64bit integer (16bit x 4 integer)
     word_t h_[8];
 };
@@ -0,0 +1,551 @@
+// Author: Hossein Taji
+
+#include "AsyncReader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define ASYNC_READER_URING 1
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// Minimal io_uring wrapper over the raw system calls, so no liburing is needed.
+// Only the I/O thread touches the rings; wake() may be called from any thread.
+// ---------------------------------------------------------------------------
+class AsyncReader::Uring {
+public:
+#ifdef ASYNC_READER_URING
+    Uring(unsigned entries, unsigned char* buffers, size_t count, size_t size) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        // One extra entry for the wake-up read.
+        fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries + 1, &params));
+        if (fd_ < 0) return;
+
+        sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+
+        sq_ring_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        cq_ring_ = single_mmap ? sq_ring_
+                               : mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+        if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED || sqes == MAP_FAILED) {
+            if (sqes != MAP_FAILED) munmap(sqes, sqes_size_);
+            release_rings();
+            return;
+        }
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        char* sq = static_cast<char*>(sq_ring_);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        char* cq = static_cast<char*>(cq_ring_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        // Registering the buffer pool lets the kernel skip pinning pages on
+        // every read. It can fail under a low RLIMIT_MEMLOCK; plain reads
+        // still work in that case.
+        std::vector<iovec> iovecs(count);
+        for (size_t i = 0; i < count; ++i) iovecs[i] = {buffers + i * size, size};
+        fixed_buffers_ = syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS,
+                                 iovecs.data(), static_cast<unsigned>(count)) == 0;
+
+        // A read of this eventfd is kept in flight, so wake() can end a
+        // wait() that no file read would end soon.
+        event_fd_ = eventfd(0, EFD_CLOEXEC);
+        if (event_fd_ < 0) {
+            munmap(sqes_, sqes_size_);
+            sqes_ = nullptr;
+            release_rings();
+            return;
+        }
+        arm_wakeup();
+    }
+
+    ~Uring() {
+        if (sqes_) munmap(sqes_, sqes_size_);
+        release_rings();
+        if (event_fd_ >= 0) ::close(event_fd_);
+    }
+
+    bool ok() const { return fd_ >= 0; }
+
+    // Queue a read into pool buffer `buffer`; sent to the kernel by wait().
+    void prepare_read(int fd, unsigned char* data, size_t buffer, size_t length, uint64_t offset) {
+        io_uring_sqe* sqe = next_sqe();
+        sqe->opcode = fixed_buffers_ ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(data);
+        sqe->len = static_cast<unsigned>(length);
+        sqe->off = offset;
+        sqe->buf_index = static_cast<uint16_t>(fixed_buffers_ ? buffer : 0);
+        sqe->user_data = buffer;
+        push_sqe();
+    }
+
+    // Submit queued reads and wait for at least one completion or a wake().
+    // Returns false if the ring failed in a way retrying will not fix.
+    bool wait(std::vector<Completion>& out) {
+        while (true) {
+            long rc = syscall(__NR_io_uring_enter, fd_, to_submit_, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (rc >= 0) {
+                to_submit_ -= std::min<unsigned>(to_submit_, static_cast<unsigned>(rc));
+                break;
+            }
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) return false;
+        }
+        bool woken = false;
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+            if (cqe.user_data == kWakeTag) woken = true;
+            else out.push_back({static_cast<size_t>(cqe.user_data), static_cast<long>(cqe.res)});
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        if (woken) arm_wakeup();
+        return true;
+    }
+
+    void wake() {
+        uint64_t one = 1;
+        ssize_t written = ::write(event_fd_, &one, sizeof(one));
+        (void)written;  // only fails if the counter is about to overflow, i.e. already signalled
+    }
+
+private:
+    static constexpr uint64_t kWakeTag = ~uint64_t(0);
+
+    io_uring_sqe* next_sqe() {
+        io_uring_sqe* sqe = &sqes_[*sq_tail_ & sq_mask_];
+        std::memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    void push_sqe() {
+        unsigned tail = *sq_tail_;
+        sq_array_[tail & sq_mask_] = tail & sq_mask_;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        ++to_submit_;
+    }
+
+    void arm_wakeup() {
+        io_uring_sqe* sqe = next_sqe();
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = event_fd_;
+        sqe->addr = reinterpret_cast<uint64_t>(&wake_count_);
+        sqe->len = sizeof(wake_count_);
+        sqe->user_data = kWakeTag;
+        push_sqe();
+    }
+
+    void release_rings() {
+        if (cq_ring_ && cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) munmap(cq_ring_, cq_size_);
+        if (sq_ring_ && sq_ring_ != MAP_FAILED) munmap(sq_ring_, sq_size_);
+        if (fd_ >= 0) ::close(fd_);
+        sq_ring_ = cq_ring_ = nullptr;
+        fd_ = -1;
+    }
+
+    int fd_ = -1;
+    void* sq_ring_ = nullptr;
+    void* cq_ring_ = nullptr;
+    size_t sq_size_ = 0, cq_size_ = 0, sqes_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+    unsigned to_submit_ = 0;
+    bool fixed_buffers_ = false;
+    int event_fd_ = -1;
+    uint64_t wake_count_ = 0;
+#else
+    Uring(unsigned, unsigned char*, size_t, size_t) {}
+    bool ok() const { return false; }
+    void prepare_read(int, unsigned char*, size_t, size_t, uint64_t) {}
+    bool wait(std::vector<Completion>&) { return false; }
+    void wake() {}
+#endif
+};
+
+bool AsyncReader::uring_available() {
+#ifdef ASYNC_READER_URING
+    static const bool available = [] {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        int fd = static_cast<int>(syscall(__NR_io_uring_setup, 1, &params));
+        if (fd < 0) return false;
+        ::close(fd);
+        return true;
+    }();
+    return available;
+#else
+    return false;
+#endif
+}
+
+const char* AsyncReader::backend_name(Backend backend) {
+    return backend == Backend::uring ? "io_uring" : "pread threads";
+}
+
+AsyncReader::AsyncReader(ThreadPool& pool, Backend backend, size_t queue_depth, size_t block_size)
+    : pool_(pool), backend_(Backend::pread), queue_depth_(std::max<size_t>(queue_depth, 1)),
+      block_size_(block_size), buffers_(nullptr) {
+    void* memory = nullptr;
+    if (posix_memalign(&memory, 4096, queue_depth_ * block_size_) != 0) throw std::bad_alloc();
+    buffers_ = static_cast<unsigned char*>(memory);
+    for (size_t i = 0; i < queue_depth_; ++i) buffer_addresses_.push_back(buffers_ + i * block_size_);
+    requests_.resize(queue_depth_);
+    for (size_t i = queue_depth_; i > 0; --i) free_buffers_.push_back(i - 1);
+
+    if (backend == Backend::uring && uring_available()) {
+        uring_ = std::make_unique<Uring>(static_cast<unsigned>(queue_depth_), buffers_, queue_depth_, block_size_);
+        if (uring_->ok()) backend_ = Backend::uring;
+        else uring_.reset();
+    }
+    if (backend_ == Backend::pread) {
+        // One blocking reader per queue slot keeps `queue_depth` reads in flight.
+        for (size_t i = 0; i < queue_depth_; ++i) pread_threads_.emplace_back([this] { pread_worker(); });
+    }
+    io_thread_ = std::thread([this] { run(); });
+}
+
+AsyncReader::~AsyncReader() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    read_ready_.notify_all();
+    io_thread_.join();
+    for (std::thread& thread : pread_threads_) thread.join();
+    uring_.reset();
+    std::free(buffers_);
+    for (unsigned char* spare : spare_buffers_) std::free(spare);
+}
+
+void AsyncReader::submit(std::filesystem::path path, BlockConsumer on_block, DoneCallback on_done) {
+    auto job = std::make_unique<Job>();
+    job->path = std::move(path);
+    job->on_block = std::move(on_block);
+    job->on_done = std::move(on_done);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.push_back(std::move(job));
+        ++outstanding_files_;
+        wake_io_locked();
+    }
+}
+
+void AsyncReader::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return outstanding_files_ == 0; });
+}
+
+// The I/O thread: open files, keep every free buffer busy with a read, and
+// route completions to hash tasks.
+void AsyncReader::run() {
+    std::vector<Completion> completed;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        admit_files(lock);
+        enqueue_deferred(lock);
+        std::vector<size_t> reads = schedule_reads_locked();
+        if (!reads.empty()) {
+            lock.unlock();
+            issue_reads(reads);
+            lock.lock();
+        }
+
+        if (backend_ == Backend::uring && inflight_ > 0) {
+            io_waiting_ = true;
+            lock.unlock();
+            completed.clear();
+            bool ok = uring_->wait(completed);
+            lock.lock();
+            io_waiting_ = false;
+            if (!ok) fall_back_to_pread_locked();
+        } else {
+            if (stop_ && inflight_ == 0 && jobs_.empty() && pending_.empty()) return;
+            wake_.wait(lock, [this] {
+                return stop_ || !completions_.empty() ||
+                       (!free_buffers_.empty() && (!submittable_.empty() || !pending_.empty()));
+            });
+            completed.swap(completions_);
+            completions_.clear();
+        }
+        for (const Completion& completion : completed) handle_completion_locked(completion);
+        enqueue_deferred(lock);
+    }
+}
+
+// Open queued files while there are buffers to read them into.
+void AsyncReader::admit_files(std::unique_lock<std::mutex>& lock) {
+    while (!pending_.empty() && !free_buffers_.empty() && jobs_.size() < queue_depth_) {
+        std::unique_ptr<Job> owned = std::move(pending_.front());
+        pending_.pop_front();
+        Job* job = owned.get();
+        jobs_.emplace(job, std::move(owned));
+
+        lock.unlock();
+        job->fd = ::open(job->path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat info;
+        bool opened = job->fd >= 0 && ::fstat(job->fd, &info) == 0;
+        if (opened) {
+            job->size = static_cast<uint64_t>(info.st_size);
+            job->chunks = static_cast<size_t>((job->size + block_size_ - 1) / block_size_);
+#ifdef POSIX_FADV_SEQUENTIAL
+            posix_fadvise(job->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        }
+        lock.lock();
+
+        if (!opened) {
+            job->failed = true;
+            maybe_finish_locked(job);
+        } else if (job->chunks == 0) {
+            maybe_finish_locked(job);
+        } else {
+            submittable_.push_back(job);
+        }
+    }
+}
+
+// Hand out free buffers round-robin across open files, one block at a time.
+std::vector<size_t> AsyncReader::schedule_reads_locked() {
+    std::vector<size_t> reads;
+    reads.swap(retries_);
+    while (!free_buffers_.empty() && !submittable_.empty()) {
+        Job* job = submittable_.front();
+        submittable_.pop_front();
+
+        size_t buffer = free_buffers_.back();
+        free_buffers_.pop_back();
+        size_t chunk = job->next_submit++;
+        uint64_t offset = static_cast<uint64_t>(chunk) * block_size_;
+        size_t length = static_cast<size_t>(std::min<uint64_t>(block_size_, job->size - offset));
+        requests_[buffer] = {job, chunk, length, 0, true};
+        ++job->inflight;
+        ++inflight_;
+        reads.push_back(buffer);
+
+        if (job->next_submit < job->chunks) submittable_.push_back(job);
+    }
+    return reads;
+}
+
+void AsyncReader::issue_reads(const std::vector<size_t>& buffers) {
+    if (backend_ == Backend::uring) {
+        for (size_t index : buffers) {
+            const Request& request = requests_[index];
+            uring_->prepare_read(request.job->fd, buffer(index) + request.done, index, request.length - request.done,
+                                 static_cast<uint64_t>(request.chunk) * block_size_ + request.done);
+        }
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        read_queue_.insert(read_queue_.end(), buffers.begin(), buffers.end());
+    }
+    read_ready_.notify_all();
+}
+
+void AsyncReader::handle_completion_locked(const Completion& completion) {
+    Request& request = requests_[completion.buffer];
+    Job* job = request.job;
+    // A read may complete short of what was asked; read the rest.
+    if (!job->failed && completion.result > 0 &&
+        request.done + static_cast<size_t>(completion.result) < request.length) {
+        request.done += static_cast<size_t>(completion.result);
+        retries_.push_back(completion.buffer);
+        return;
+    }
+    request.reading = false;
+    --job->inflight;
+    --inflight_;
+
+    if (completion.result > 0) {
+        request.done += static_cast<size_t>(completion.result);
+    } else if (completion.result == 0 && !job->failed) {
+        // End of file before st_size: the file shrank, or its size is nominal
+        // (sysfs). Like a plain read, hash what is there.
+        end_file_locked(job, request.done > 0 ? request.chunk + 1 : request.chunk);
+    }
+
+    if (job->failed || completion.result < 0) {
+        release_buffer_locked(completion.buffer);
+        fail_job_locked(job);
+    } else if (request.chunk >= job->chunks) {
+        release_buffer_locked(completion.buffer);  // past the end of file
+    } else {
+        job->ready[request.chunk] = {completion.buffer, request.done};
+        if (!job->draining && request.chunk == job->next_deliver) {
+            job->draining = true;
+            deferred_tasks_.push_back([this, job] { drain(job); });
+        }
+    }
+    maybe_finish_locked(job);
+}
+
+// Runs on a pool worker: feed every in-order block that is ready.
+void AsyncReader::drain(Job* job) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!job->failed) {
+        auto it = job->ready.find(job->next_deliver);
+        if (it == job->ready.end()) break;
+        Chunk chunk = it->second;
+        job->ready.erase(it);
+
+        lock.unlock();
+        job->on_block(buffer(chunk.buffer), chunk.length);
+        lock.lock();
+
+        release_buffer_locked(chunk.buffer);
+        ++job->next_deliver;
+    }
+    job->draining = false;
+    maybe_finish_locked(job);
+    enqueue_deferred(lock);
+}
+
+void AsyncReader::fail_job_locked(Job* job) {
+    if (!job->failed) {
+        job->failed = true;
+        submittable_.erase(std::remove(submittable_.begin(), submittable_.end(), job), submittable_.end());
+    }
+    if (job->draining) return;  // the drain task gives its blocks back itself
+    for (const auto& entry : job->ready) release_buffer_locked(entry.second.buffer);
+    job->ready.clear();
+}
+
+// The file ends after `chunks` blocks: stop reading and drop later blocks.
+void AsyncReader::end_file_locked(Job* job, size_t chunks) {
+    if (chunks >= job->chunks) return;
+    job->chunks = chunks;
+    submittable_.erase(std::remove(submittable_.begin(), submittable_.end(), job), submittable_.end());
+    for (auto it = job->ready.lower_bound(chunks); it != job->ready.end(); it = job->ready.erase(it)) {
+        release_buffer_locked(it->second.buffer);
+    }
+}
+
+void AsyncReader::maybe_finish_locked(Job* job) {
+    if (job->draining || job->inflight > 0) return;
+    if (job->failed) fail_job_locked(job);
+    else if (job->next_deliver < job->chunks) return;
+
+    auto it = jobs_.find(job);
+    std::unique_ptr<Job> owned = std::move(it->second);
+    jobs_.erase(it);
+    if (owned->fd >= 0) ::close(owned->fd);
+
+    // Counted as finished once the callback is in the pool, so wait() cannot
+    // return before it is queued.
+    bool ok = !owned->failed;
+    deferred_tasks_.push_back([done = std::move(owned->on_done), ok] { done(ok); });
+    ++deferred_finished_;
+    wake_io_locked();
+}
+
+// Hand tasks queued under the lock to the pool, without holding the lock:
+// enqueue may block until the pool has room, and the workers need the lock.
+void AsyncReader::enqueue_deferred(std::unique_lock<std::mutex>& lock) {
+    if (deferred_tasks_.empty()) return;
+    std::vector<Task> tasks;
+    tasks.swap(deferred_tasks_);
+    size_t finished = deferred_finished_;
+    deferred_finished_ = 0;
+    lock.unlock();
+    for (Task& task : tasks) pool_.enqueue(std::move(task));
+    lock.lock();
+    outstanding_files_ -= finished;
+    if (finished > 0 && outstanding_files_ == 0) idle_.notify_all();
+}
+
+void AsyncReader::release_buffer_locked(size_t buffer) {
+    free_buffers_.push_back(buffer);
+    wake_io_locked();
+}
+
+// The I/O thread may be blocked in io_uring_enter rather than on wake_.
+void AsyncReader::wake_io_locked() {
+    wake_.notify_one();
+    if (io_waiting_) {
+        io_waiting_ = false;
+        uring_->wake();
+    }
+}
+
+// io_uring_enter failed in a way retrying will not fix. The kernel may still
+// complete the reads it holds, so each restarts on pread threads in a fresh
+// buffer and the old one is never reused.
+void AsyncReader::fall_back_to_pread_locked() {
+    backend_ = Backend::pread;
+    retries_.clear();
+    for (size_t index = 0; index < queue_depth_; ++index) {
+        Request& request = requests_[index];
+        if (!request.reading) continue;
+        void* memory = nullptr;
+        if (posix_memalign(&memory, 4096, block_size_) != 0) throw std::bad_alloc();
+        spare_buffers_.push_back(static_cast<unsigned char*>(memory));
+        buffer_addresses_[index] = spare_buffers_.back();
+        request.done = 0;
+        read_queue_.push_back(index);
+    }
+    for (size_t i = 0; i < queue_depth_; ++i) pread_threads_.emplace_back([this] { pread_worker(); });
+    read_ready_.notify_all();
+}
+
+void AsyncReader::pread_worker() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        read_ready_.wait(lock, [this] { return stop_ || !read_queue_.empty(); });
+        if (read_queue_.empty()) return;
+        size_t index = read_queue_.front();
+        read_queue_.pop_front();
+        Request request = requests_[index];
+        lock.unlock();
+
+        uint64_t offset = static_cast<uint64_t>(request.chunk) * block_size_;
+        size_t done = request.done;
+        long result = 0;
+        while (done < request.length) {
+            ssize_t got = ::pread(request.job->fd, buffer(index) + done, request.length - done,
+                                  static_cast<off_t>(offset + done));
+            if (got < 0 && errno == EINTR) continue;
+            if (got < 0) { result = -errno; break; }
+            if (got == 0) break;
+            done += static_cast<size_t>(got);
+        }
+        // Like io_uring, report what this attempt read; 0 means end of file.
+        if (result == 0) result = static_cast<long>(done - request.done);
+
+        lock.lock();
+        completions_.push_back({index, result});
+        wake_.notify_one();
+    }
+}
@@ -0,0 +1,224 @@
+// Author: Hossein Taji
+
+#include "DirectoryWalker.h"
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include "Trace.h"
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+
+struct DirectoryWalker::Directory {
+    int fd;
+    std::string path;  // with a trailing separator, ready for appending names
+
+    Directory(int fd, std::string path) : fd(fd), path(std::move(path)) {}
+    ~Directory() { ::close(fd); }
+};
+
+namespace {
+
+// Layout of the records returned by getdents64(2).
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+const size_t kDirentBufferSize = 256 * 1024;
+
+// Each pending directory may pin its parent's descriptor, so allow as many
+// open files as the hard limit permits.
+void raise_open_file_limit() {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+}  // namespace
+
+#else
+
+struct DirectoryWalker::Directory {
+    std::filesystem::path path;
+};
+
+#endif
+
+DirectoryWalker::DirectoryWalker(ThreadPool& pool, FileCallback on_files, NameFilter accept, bool need_sizes)
+    : pool_(pool), on_files_(std::move(on_files)), accept_(std::move(accept)), need_sizes_(need_sizes) {
+#ifdef __linux__
+    raise_open_file_limit();
+#endif
+}
+
+bool DirectoryWalker::walk(const std::filesystem::path& root, bool recursive) {
+    recursive_ = recursive;
+#ifdef __linux__
+    int fd = ::open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) { add_error(root.string(), errno); return false; }
+    std::string path = root.string();
+    if (path.empty() || path.back() != '/') path += '/';
+    auto directory = std::make_shared<Directory>(fd, std::move(path));
+#else
+    std::error_code ec;
+    if (!std::filesystem::is_directory(root, ec)) { add_error(root.string(), ENOTDIR); return false; }
+    auto directory = std::make_shared<Directory>(Directory{root});
+#endif
+    ++pending_;
+    pool_.enqueue([this, directory] { scan(directory); });
+    return true;
+}
+
+void DirectoryWalker::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return pending_ == 0; });
+}
+
+std::vector<std::string> DirectoryWalker::errors() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return errors_;
+}
+
+void DirectoryWalker::add_error(const std::string& path, int error) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    errors_.push_back(path + ": " + std::generic_category().message(error));
+}
+
+void DirectoryWalker::finish_one() {
+    if (--pending_ == 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_.notify_all();
+    }
+}
+
+void DirectoryWalker::report_files(std::vector<File>& files) {
+    if (files.empty()) return;
+    on_files_(files);
+    files.clear();
+}
+
+#ifdef __linux__
+
+// Queue a subdirectory. It is opened inside its own task, relative to the
+// parent, which stays open until then.
+void DirectoryWalker::spawn(std::shared_ptr<Directory> parent, std::string name) {
+    ++pending_;
+    pool_.spawn([this, parent = std::move(parent), name = std::move(name)]() mutable {
+        int fd = ::openat(parent->fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0) {
+            add_error(parent->path + name, errno);
+        } else {
+            auto directory = std::make_shared<Directory>(fd, parent->path + name + '/');
+            parent.reset();
+            scan(std::move(directory));
+            return;
+        }
+        finish_one();
+    });
+}
+
+void DirectoryWalker::scan(std::shared_ptr<Directory> directory) {
+    Trace::Span span("scan directory");
+    thread_local std::unique_ptr<char[]> buffer(new char[kDirentBufferSize]);
+    std::vector<File> files;
+    while (true) {
+        long got = syscall(SYS_getdents64, directory->fd, buffer.get(), kDirentBufferSize);
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            add_error(directory->path, errno);
+            break;
+        }
+        if (got == 0) break;
+
+        for (long offset = 0; offset < got;) {
+            const linux_dirent64* entry = reinterpret_cast<const linux_dirent64*>(buffer.get() + offset);
+            offset += entry->d_reclen;
+            const char* name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+            unsigned char type = entry->d_type;
+            struct stat info;
+            bool have_info = false;
+            if (type == DT_UNKNOWN) {
+                // Some filesystems do not fill in d_type; fall back to a stat.
+                if (fstatat(directory->fd, name, &info, AT_SYMLINK_NOFOLLOW) != 0) continue;
+                have_info = true;
+                type = S_ISDIR(info.st_mode) ? DT_DIR : S_ISREG(info.st_mode) ? DT_REG : S_ISLNK(info.st_mode) ? DT_LNK : DT_UNKNOWN;
+            }
+
+            if (type == DT_DIR) {
+                if (recursive_) spawn(directory, name);
+                continue;
+            }
+            if (type != DT_REG && type != DT_LNK) continue;
+
+            std::string file_name(name);
+            if (accept_ && !accept_(file_name)) continue;
+
+            // Symlinks count when they point at a regular file (their target is
+            // not descended into if it is a directory).
+            if (type == DT_LNK) {
+                if (fstatat(directory->fd, name, &info, 0) != 0 || !S_ISREG(info.st_mode)) continue;
+                have_info = true;
+            }
+            std::uintmax_t size = kUnknownSize;
+            if (need_sizes_ && !have_info && fstatat(directory->fd, name, &info, AT_SYMLINK_NOFOLLOW) == 0) have_info = true;
+            if (need_sizes_ && have_info) size = static_cast<std::uintmax_t>(info.st_size);
+            files.push_back({directory->path + file_name, size});
+        }
+        report_files(files);
+    }
+    directory.reset();
+    finish_one();
+}
+
+#else
+
+void DirectoryWalker::spawn(std::shared_ptr<Directory> parent, std::string name) {
+    ++pending_;
+    auto directory = std::make_shared<Directory>(Directory{parent->path / name});
+    pool_.spawn([this, directory] { scan(directory); });
+}
+
+// Portable fallback: still one task per directory, using std::filesystem.
+void DirectoryWalker::scan(std::shared_ptr<Directory> directory) {
+    Trace::Span span("scan directory");
+    const size_t kBatchSize = 1024;
+    std::vector<File> files;
+    std::error_code ec;
+    for (std::filesystem::directory_iterator it(directory->path, ec), end; !ec && it != end; it.increment(ec)) {
+        const auto& entry = *it;
+        std::error_code type_ec;
+        if (entry.is_directory(type_ec) && !entry.is_symlink(type_ec)) {
+            if (recursive_) spawn(directory, entry.path().filename().string());
+            continue;
+        }
+        if (!entry.is_regular_file(type_ec)) continue;
+        std::string name = entry.path().filename().string();
+        if (accept_ && !accept_(name)) continue;
+        std::uintmax_t size = need_sizes_ ? entry.file_size(type_ec) : kUnknownSize;
+        files.push_back({directory->path / name, type_ec ? kUnknownSize : size});
+        if (files.size() >= kBatchSize) report_files(files);
+    }
+    report_files(files);
+    if (ec) add_error(directory->path.string(), ec.value());
+    finish_one();
+}
+
+#endif
@@ -0,0 +1,223 @@
+// Author: Hossein Taji
+
+#include "FileReader.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#include "Trace.h"
+
+#ifdef _WIN32
+#include <fstream>
+#include <malloc.h>
+#else
+#include <cerrno>
+#include <csetjmp>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+FileReader::FileReader(Mode mode, size_t block_size) : mode_(mode), buffer_(nullptr), block_size_(block_size) {
+    // Round the block size up to a whole number of pages so reads stay aligned.
+    block_size_ = (block_size_ + kBufferAlignment - 1) / kBufferAlignment * kBufferAlignment;
+    if (block_size_ == 0) block_size_ = kBufferAlignment;
+#ifdef _WIN32
+    buffer_ = static_cast<unsigned char*>(_aligned_malloc(block_size_, kBufferAlignment));
+    if (!buffer_) throw std::bad_alloc();
+#else
+    void* memory = nullptr;
+    if (posix_memalign(&memory, kBufferAlignment, block_size_) != 0) throw std::bad_alloc();
+    buffer_ = static_cast<unsigned char*>(memory);
+#endif
+}
+
+FileReader::~FileReader() {
+#ifdef _WIN32
+    _aligned_free(buffer_);
+#else
+    std::free(buffer_);
+#endif
+}
+
+bool FileReader::parse_mode(const std::string& name, Mode& mode) {
+    if (name == "read") { mode = Mode::read; return true; }
+    if (name == "mmap") { mode = Mode::mmap; return true; }
+    return false;
+}
+
+const char* FileReader::mode_name(Mode mode) {
+    return mode == Mode::mmap ? "mmap" : "read";
+}
+
+#ifdef _WIN32
+
+// Windows has no mmap(); both modes use buffered reads.
+bool FileReader::read(const std::filesystem::path& path, const BlockConsumer& consume) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+    while (file) {
+        file.read(reinterpret_cast<char*>(buffer_), static_cast<std::streamsize>(block_size_));
+        std::streamsize got = file.gcount();
+        if (got > 0) consume(buffer_, static_cast<size_t>(got));
+    }
+    return !file.bad();
+}
+
+bool FileReader::read_range(const std::filesystem::path& path, uint64_t offset, uint64_t length,
+                            const BlockConsumer& consume) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open() || !file.seekg(static_cast<std::streamoff>(offset))) return false;
+    while (length > 0 && file) {
+        file.read(reinterpret_cast<char*>(buffer_), static_cast<std::streamsize>(std::min<uint64_t>(block_size_, length)));
+        std::streamsize got = file.gcount();
+        if (got > 0) consume(buffer_, static_cast<size_t>(got));
+        length -= static_cast<uint64_t>(got);
+    }
+    return !file.bad();
+}
+
+#else
+
+namespace {
+// A mapped file that is truncated underneath us raises SIGBUS on the next
+// access to a page past the new end. While a mapping is being consumed, the
+// handler jumps back into read_mapped, which reports a read error instead of
+// the whole run being killed.
+struct MappedGuard {
+    sigjmp_buf* jump;
+    const unsigned char* begin;
+    const unsigned char* end;
+};
+thread_local MappedGuard mapped_guard{nullptr, nullptr, nullptr};
+
+void on_sigbus(int signal, siginfo_t* info, void*) {
+    const unsigned char* address = static_cast<const unsigned char*>(info->si_addr);
+    if (mapped_guard.jump && address >= mapped_guard.begin && address < mapped_guard.end) {
+        siglongjmp(*mapped_guard.jump, 1);
+    }
+    // Not ours: die as we would have without the handler.
+    std::signal(signal, SIG_DFL);
+    std::raise(signal);
+}
+
+bool install_sigbus_handler() {
+    struct sigaction action {};
+    action.sa_sigaction = on_sigbus;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    return ::sigaction(SIGBUS, &action, nullptr) == 0;
+}
+}
+
+bool FileReader::read(const std::filesystem::path& path, const BlockConsumer& consume) {
+    int fd;
+    {
+        Trace::Span span("open");
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0) return false;
+    bool ok = mode_ == Mode::mmap ? read_mapped(fd, consume) : read_blocks(fd, consume);
+    ::close(fd);
+    return ok;
+}
+
+bool FileReader::read_blocks(int fd, const BlockConsumer& consume) {
+    // Tell the kernel we will read front to back so it can read ahead aggressively.
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    off_t offset = 0;
+    while (true) {
+        ssize_t got;
+        {
+            Trace::Span span("read");
+            got = ::pread(fd, buffer_, block_size_, offset);
+            span.set_bytes(got);
+        }
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (got == 0) return true;
+        consume(buffer_, static_cast<size_t>(got));
+        offset += got;
+    }
+}
+
+bool FileReader::read_range(const std::filesystem::path& path, uint64_t offset, uint64_t length,
+                            const BlockConsumer& consume) {
+    int fd;
+    {
+        Trace::Span span("open");
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0) return false;
+    bool ok = true;
+    while (length > 0) {
+        ssize_t got;
+        {
+            Trace::Span span("read");
+            got = ::pread(fd, buffer_, static_cast<size_t>(std::min<uint64_t>(block_size_, length)), static_cast<off_t>(offset));
+            span.set_bytes(got);
+        }
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            ok = false;
+            break;
+        }
+        if (got == 0) break;
+        consume(buffer_, static_cast<size_t>(got));
+        offset += static_cast<uint64_t>(got);
+        length -= static_cast<uint64_t>(got);
+    }
+    ::close(fd);
+    return ok;
+}
+
+bool FileReader::read_mapped(int fd, const BlockConsumer& consume) {
+    struct stat info;
+    if (::fstat(fd, &info) != 0) return false;
+    // Special files report no useful size; read them the ordinary way.
+    if (!S_ISREG(info.st_mode)) return read_blocks(fd, consume);
+    size_t size = static_cast<size_t>(info.st_size);
+    if (size == 0) return true;
+
+    static const bool guarded = install_sigbus_handler();
+    if (!guarded) return read_blocks(fd, consume);
+
+    void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) return read_blocks(fd, consume);
+    const unsigned char* data = static_cast<const unsigned char*>(mapping);
+    ::madvise(mapping, size, MADV_SEQUENTIAL);
+
+    // A fault abandons the consumer mid-block; its partial result is discarded.
+    sigjmp_buf jump;
+    bool truncated = false;
+    if (sigsetjmp(jump, 1) != 0) {
+        truncated = true;
+    } else {
+        mapped_guard = {&jump, data, data + size};
+        // Hand the mapping over in windows, asking the kernel to start paging in
+        // the next window while the current one is being hashed.
+        ::madvise(mapping, std::min(size, kMapWindowSize), MADV_WILLNEED);
+        for (size_t offset = 0; offset < size; offset += kMapWindowSize) {
+            size_t length = std::min(kMapWindowSize, size - offset);
+            size_t next = offset + length;
+            if (next < size) {
+                ::madvise(const_cast<unsigned char*>(data) + next, std::min(kMapWindowSize, size - next), MADV_WILLNEED);
+            }
+            consume(data + offset, length);
+        }
+    }
+    mapped_guard = {nullptr, nullptr, nullptr};
+
+    ::munmap(mapping, size);
+    return !truncated;
+}
+
+#endif
@@ -0,0 +1,227 @@
+// Author: Hossein Taji
+
+#include "HashCache.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+const char kMagic[8] = {'P', 'F', 'H', 'C', 'A', 'C', 'H', 'E'};
+const uint32_t kVersion = 1;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+};
+
+// Compact once there are more superseded records than live ones (and enough
+// of them to be worth a rewrite).
+const size_t kMinCompactRecords = 64;
+
+// A file whatever its version; only its newest record is live.
+struct Identity {
+    uint64_t device;
+    uint64_t inode;
+    uint64_t kind;
+
+    bool operator==(const Identity& other) const {
+        return device == other.device && inode == other.inode && kind == other.kind;
+    }
+};
+
+struct IdentityHash {
+    size_t operator()(const Identity& identity) const {
+        uint64_t h = identity.inode * 0x9e3779b97f4a7c15ull;
+        h = (h ^ identity.device) * 0xff51afd7ed558ccdull;
+        h = (h ^ identity.kind) * 0xff51afd7ed558ccdull;
+        return static_cast<size_t>(h ^ (h >> 32));
+    }
+};
+
+Identity identity_of(const HashCache::Key& key) {
+    return {key.device, key.inode, key.kind};
+}
+}
+
+// One on-disk entry, used directly from the mapping.
+struct HashCache::Record {
+    Key key;
+    Digest digest;
+};
+
+static_assert(sizeof(HashCache::Key) == 48, "cache records must not contain padding");
+
+bool HashCache::Key::operator==(const Key& other) const {
+    return device == other.device && inode == other.inode && size == other.size &&
+           mtime_ns == other.mtime_ns && ctime_ns == other.ctime_ns && kind == other.kind;
+}
+
+size_t HashCache::KeyHash::operator()(const Key& key) const {
+    uint64_t h = key.inode * 0x9e3779b97f4a7c15ull;
+    for (uint64_t part : {key.device, key.size, static_cast<uint64_t>(key.mtime_ns), static_cast<uint64_t>(key.ctime_ns), key.kind}) {
+        h = (h ^ part) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    }
+    return static_cast<size_t>(h);
+}
+
+std::filesystem::path HashCache::default_path() {
+    std::filesystem::path base;
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) base = xdg;
+    else if (const char* home = std::getenv("HOME"); home && *home) base = std::filesystem::path(home) / ".cache";
+    else return {};
+    return base / "parallel-file-hasher" / "hashes.cache";
+}
+
+bool HashCache::make_key(const std::filesystem::path& path, uint64_t kind, Key& key) {
+#ifdef _WIN32
+    (void)path; (void)kind; (void)key;
+    return false;
+#else
+    struct stat info;
+    if (::stat(path.c_str(), &info) != 0) return false;
+    key.device = static_cast<uint64_t>(info.st_dev);
+    key.inode = static_cast<uint64_t>(info.st_ino);
+    key.size = static_cast<uint64_t>(info.st_size);
+#ifdef __APPLE__
+    key.mtime_ns = static_cast<int64_t>(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+    key.ctime_ns = static_cast<int64_t>(info.st_ctimespec.tv_sec) * 1000000000 + info.st_ctimespec.tv_nsec;
+#else
+    key.mtime_ns = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+    key.ctime_ns = static_cast<int64_t>(info.st_ctim.tv_sec) * 1000000000 + info.st_ctim.tv_nsec;
+#endif
+    key.kind = kind;
+    return true;
+#endif
+}
+
+HashCache::HashCache(std::filesystem::path file, bool rebuild) : file_(std::move(file)), rebuild_(rebuild) {
+    if (!rebuild_) load();
+}
+
+HashCache::~HashCache() {
+#ifndef _WIN32
+    if (mapping_ && contents_.empty()) ::munmap(const_cast<unsigned char*>(mapping_), mapping_size_);
+#endif
+}
+
+void HashCache::load() {
+#ifdef _WIN32
+    std::ifstream in(file_, std::ios::binary);
+    if (!in) return;
+    contents_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    mapping_ = contents_.data();
+    mapping_size_ = contents_.size();
+#else
+    int fd = ::open(file_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat info;
+    if (::fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(Header)) {
+        void* mapping = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            mapping_ = static_cast<const unsigned char*>(mapping);
+            mapping_size_ = static_cast<size_t>(info.st_size);
+        }
+    }
+    ::close(fd);
+    if (!mapping_) return;
+#endif
+    // An unrecognised file is treated as empty and replaced at save().
+    Header header;
+    if (mapping_size_ < sizeof(header)) { rebuild_ = true; return; }
+    std::memcpy(&header, mapping_, sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+        header.record_size != sizeof(Record)) {
+        rebuild_ = true;
+        return;
+    }
+    // A torn record at the end (an interrupted append) is ignored.
+    file_records_ = (mapping_size_ - sizeof(Header)) / sizeof(Record);
+    const Record* records = file_records();
+    index_.reserve(file_records_);
+    for (size_t i = 0; i < file_records_; ++i) index_[records[i].key] = &records[i];
+}
+
+const HashCache::Record* HashCache::file_records() const {
+    return reinterpret_cast<const Record*>(mapping_ + sizeof(Header));
+}
+
+bool HashCache::lookup(const Key& key, Digest& digest) {
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+        ++misses_;
+        return false;
+    }
+    digest = it->second->digest;
+    ++hits_;
+    return true;
+}
+
+void HashCache::insert(const Key& key, const Digest& digest) {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    pending_.push_back({key, digest});
+}
+
+bool HashCache::save() {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    std::error_code ec;
+    std::filesystem::create_directories(file_.parent_path(), ec);
+
+    // Nothing new: the last save already compacted if it was due.
+    if (!rebuild_ && file_records_ > 0 && pending_.empty()) return true;
+
+    // Index of each file's newest record, counting pending ones after the file.
+    const size_t total = file_records_ + pending_.size();
+    auto record = [&](size_t i) -> const Record& {
+        return i < file_records_ ? file_records()[i] : pending_[i - file_records_];
+    };
+    std::unordered_map<Identity, size_t, IdentityHash> newest;
+    newest.reserve(total);
+    for (size_t i = 0; i < total; ++i) newest[identity_of(record(i).key)] = i;
+
+    size_t superseded = total - newest.size();
+    if (rebuild_ || file_records_ == 0 || (superseded >= kMinCompactRecords && superseded > newest.size())) {
+        std::vector<Record> records;
+        records.reserve(newest.size());
+        for (size_t i = 0; i < total; ++i) {
+            if (newest[identity_of(record(i).key)] == i) records.push_back(record(i));
+        }
+        if (!rewrite(records)) return false;
+    } else if (!pending_.empty()) {
+        std::ofstream out(file_, std::ios::binary | std::ios::app);
+        out.write(reinterpret_cast<const char*>(pending_.data()), static_cast<std::streamsize>(pending_.size() * sizeof(Record)));
+        if (!out) return false;
+    }
+    pending_.clear();
+    return true;
+}
+
+// Write a fresh file next to the old one and rename it over, so readers and
+// a crash never see a half-written cache.
+bool HashCache::rewrite(const std::vector<Record>& records) {
+    std::filesystem::path temporary = file_;
+    temporary += ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        Header header;
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.record_size = sizeof(Record);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(Record)));
+        if (!out) return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(temporary, file_, ec);
+    return !ec;
+}
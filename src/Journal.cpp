@@ -0,0 +1,166 @@
+// Author: Hossein Taji
+
+#include "Journal.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+const char kHeader[] = "PFHJOURNAL 1\n";
+
+// Wake the writer early once this much is waiting, to bound memory.
+const size_t kFlushBytes = 1 << 20;
+
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// "<size> <mtime_ns> <kind> <hex digest> <path>"
+bool parse_record(const std::string& line, std::string& path, Journal::Entry& entry) {
+    const char* text = line.c_str();
+    char* end;
+    entry.size = std::strtoull(text, &end, 10);
+    if (*end != ' ') return false;
+    entry.mtime_ns = std::strtoll(end + 1, &end, 10);
+    if (*end != ' ') return false;
+    entry.kind = std::strtoull(end + 1, &end, 10);
+    if (*end != ' ') return false;
+    const char* hex = end + 1;
+    for (size_t i = 0; i < entry.digest.size(); ++i) {
+        int high = hex_value(hex[2 * i]);
+        int low = high < 0 ? -1 : hex_value(hex[2 * i + 1]);
+        if (low < 0) return false;
+        entry.digest[i] = static_cast<unsigned char>(high << 4 | low);
+    }
+    const char* name = hex + 2 * entry.digest.size();
+    if (*name != ' ' || name[1] == '\0') return false;
+    path.assign(name + 1);
+    return true;
+}
+}
+
+Journal::~Journal() {
+    close();
+}
+
+bool Journal::open(const std::filesystem::path& path, std::chrono::milliseconds sync_interval, std::string& error) {
+    if (!load(path, error)) return false;
+    file_ = std::fopen(path.string().c_str(), "ab");
+    if (!file_) { error = "cannot open " + path.string() + " for writing"; return false; }
+    std::setvbuf(file_, nullptr, _IONBF, 0);
+    if (std::ftell(file_) == 0 && !flush(kHeader)) {
+        error = "cannot write " + path.string();
+        std::fclose(file_);
+        file_ = nullptr;
+        return false;
+    }
+    sync_interval_ = sync_interval;
+    thread_ = std::thread([this] { run(); });
+    return true;
+}
+
+bool Journal::load(const std::filesystem::path& path, std::string& error) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return true;  // a new journal
+    std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    if (contents.empty()) return true;
+    if (contents.compare(0, sizeof(kHeader) - 1, kHeader) != 0) {
+        error = path.string() + " is not a journal written by this tool";
+        return false;
+    }
+    // Drop a record cut short by a crash so new records start on a fresh line.
+    size_t valid = contents.rfind('\n') + 1;
+    if (valid < contents.size()) {
+        std::error_code ec;
+        std::filesystem::resize_file(path, valid, ec);
+        if (ec) { error = "cannot repair " + path.string() + ": " + ec.message(); return false; }
+    }
+    std::string line, name;
+    Entry entry;
+    for (size_t start = sizeof(kHeader) - 1; start < valid;) {
+        size_t end = contents.find('\n', start);
+        line.assign(contents, start, end - start);
+        start = end + 1;
+        // A later record for the same path supersedes an earlier one.
+        if (parse_record(line, name, entry)) records_[name] = entry;
+    }
+    return true;
+}
+
+const Journal::Entry* Journal::find(const std::filesystem::path& path) const {
+    auto it = records_.find(path.string());
+    return it == records_.end() ? nullptr : &it->second;
+}
+
+void Journal::append(const std::filesystem::path& path, const Entry& entry) {
+    std::string name = path.string();
+    // Records are line based.
+    if (name.find('\n') != std::string::npos) return;
+    static const char digits[] = "0123456789abcdef";
+    std::string line = std::to_string(entry.size) + ' ' + std::to_string(entry.mtime_ns) + ' ' + std::to_string(entry.kind) + ' ';
+    for (unsigned char byte : entry.digest) {
+        line += digits[byte >> 4];
+        line += digits[byte & 15];
+    }
+    line += ' ';
+    line += name;
+    line += '\n';
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_ += line;
+        wake = pending_.size() >= kFlushBytes;
+    }
+    ++appended_;
+    if (wake) wake_.notify_one();
+}
+
+bool Journal::close() {
+    if (!file_) return !failed_;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closing_ = true;
+    }
+    wake_.notify_one();
+    if (thread_.joinable()) thread_.join();
+    if (std::fclose(file_) != 0) failed_ = true;
+    file_ = nullptr;
+    return !failed_;
+}
+
+bool Journal::flush(const std::string& text) {
+    if (!text.empty() && std::fwrite(text.data(), 1, text.size(), file_) != text.size()) return false;
+#ifdef _WIN32
+    return _commit(_fileno(file_)) == 0;
+#else
+    return fsync(fileno(file_)) == 0;
+#endif
+}
+
+void Journal::run() {
+    std::string batch;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        wake_.wait_for(lock, sync_interval_, [this] { return closing_ || pending_.size() >= kFlushBytes; });
+        bool last = closing_;
+        batch.swap(pending_);
+        lock.unlock();
+        bool ok = batch.empty() || flush(batch);
+        batch.clear();
+        lock.lock();
+        if (!ok) failed_ = true;
+        if (last) return;
+    }
+}
@@ -0,0 +1,79 @@
+// Author: Hossein Taji
+
+#include "Manifest.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+
+namespace {
+bool is_hex_digest(const std::string& text, size_t length) {
+    return text.size() >= length && std::all_of(text.begin(), text.begin() + length, [](unsigned char c) { return std::isxdigit(c); });
+}
+
+// Hex digits are compared in lower case; a tree-hash label before the last
+// ':' is kept as written.
+std::string normalise_digest(std::string text) {
+    size_t label_end = text.rfind(':');
+    auto first = label_end == std::string::npos ? text.begin() : text.begin() + label_end + 1;
+    std::transform(first, text.end(), first, [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+// sha256sum escapes names containing a backslash or newline and marks the
+// line with a leading backslash.
+std::string unescape(const std::string& name) {
+    std::string result;
+    for (size_t i = 0; i < name.size(); ++i) {
+        if (name[i] == '\\' && i + 1 < name.size()) {
+            ++i;
+            result += name[i] == 'n' ? '\n' : name[i];
+        } else {
+            result += name[i];
+        }
+    }
+    return result;
+}
+}
+
+std::string Manifest::key(const std::filesystem::path& path) {
+    return path.lexically_normal().string();
+}
+
+bool Manifest::load(const std::filesystem::path& file, std::string& error) {
+    std::ifstream in(file);
+    if (!in.is_open()) { error = "cannot open " + file.string(); return false; }
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(in, line)) {
+        ++line_number;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+
+        Entry entry;
+        bool escaped = line[0] == '\\';
+        std::string body = escaped ? line.substr(1) : line;
+        if (is_hex_digest(body, 64) && body.size() > 66 && body[64] == ' ' && (body[65] == ' ' || body[65] == '*')) {
+            entry.expected = normalise_digest(body.substr(0, 64));
+            entry.path = escaped ? unescape(body.substr(66)) : body.substr(66);
+        } else {
+            size_t separator = line.rfind(": ");
+            if (separator == std::string::npos || separator == 0 || separator + 2 == line.size()) {
+                error = file.string() + ":" + std::to_string(line_number) + ": unrecognised line";
+                return false;
+            }
+            entry.path = line.substr(0, separator);
+            entry.expected = normalise_digest(line.substr(separator + 2));
+        }
+        // A repeated path keeps its last digest, as a later run would have written it.
+        auto inserted = index_.emplace(key(entry.path), entries_.size());
+        if (inserted.second) entries_.push_back(std::move(entry));
+        else entries_[inserted.first->second] = std::move(entry);
+    }
+    return true;
+}
+
+size_t Manifest::find(const std::filesystem::path& path) const {
+    auto it = index_.find(key(path));
+    return it == index_.end() ? npos : it->second;
+}
@@ -0,0 +1,162 @@
+// Author: Hossein Taji
+
+#include "MetricsExporter.h"
+
+#include <cstdio>
+#include <fstream>
+#include <system_error>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// How often the HTTP thread checks for stop() while no one is scraping.
+const int kPollMilliseconds = 200;
+
+std::string format_value(double value) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.17g", value);
+    return text;
+}
+
+#ifndef _WIN32
+bool send_all(int fd, const std::string& data) {
+    for (size_t sent = 0; sent < data.size();) {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+#endif
+}
+
+MetricsExporter::~MetricsExporter() {
+    stop();
+}
+
+void MetricsExporter::add(std::string name, std::string help, Type type, Sample sample) {
+    metrics_.push_back({std::move(name), std::move(help), type, std::move(sample)});
+}
+
+bool MetricsExporter::start(const std::filesystem::path& textfile, int port, std::chrono::seconds interval, std::string& error) {
+    textfile_ = textfile;
+    interval_ = interval.count() > 0 ? interval : std::chrono::seconds(1);
+    if (port != 0) {
+#ifdef _WIN32
+        error = "the HTTP endpoint is not available on Windows";
+        return false;
+#else
+        listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0) { error = std::generic_category().message(errno); return false; }
+        int reuse = 1;
+        ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        // Local only: the endpoint has no authentication.
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listen_fd_, 16) != 0) {
+            error = "port " + std::to_string(port) + ": " + std::generic_category().message(errno);
+            ::close(listen_fd_);
+            listen_fd_ = -1;
+            return false;
+        }
+        http_thread_ = std::thread([this] { run_http(); });
+#endif
+    }
+    if (!textfile_.empty()) textfile_thread_ = std::thread([this] { run_textfile(); });
+    started_ = true;
+    return true;
+}
+
+void MetricsExporter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!started_ || stopping_) return;
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    if (textfile_thread_.joinable()) textfile_thread_.join();
+    if (http_thread_.joinable()) http_thread_.join();
+#ifndef _WIN32
+    if (listen_fd_ >= 0) ::close(listen_fd_);
+    listen_fd_ = -1;
+#endif
+    // Leave the final values behind for the collector.
+    if (!textfile_.empty()) write_textfile();
+}
+
+std::string MetricsExporter::render() const {
+    std::string out;
+    for (const Metric& metric : metrics_) {
+        out += "# HELP " + metric.name + " " + metric.help + "\n";
+        out += "# TYPE " + metric.name + (metric.type == Type::counter ? " counter\n" : " gauge\n");
+        out += metric.name + " " + format_value(metric.sample()) + "\n";
+    }
+    return out;
+}
+
+// The collector may read at any moment, so it must never see a partial file.
+bool MetricsExporter::write_textfile() const {
+    std::filesystem::path temporary = textfile_;
+    temporary += ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::trunc);
+        out << render();
+        if (!out) return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(temporary, textfile_, ec);
+    return !ec;
+}
+
+void MetricsExporter::run_textfile() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        lock.unlock();
+        write_textfile();
+        lock.lock();
+        wake_.wait_for(lock, interval_, [this] { return stopping_; });
+    }
+}
+
+void MetricsExporter::run_http() {
+#ifndef _WIN32
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) return;
+        }
+        pollfd listener{listen_fd_, POLLIN, 0};
+        if (::poll(&listener, 1, kPollMilliseconds) <= 0) continue;
+        int client = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) continue;
+        // One short request per connection; a slow client cannot stall us for long.
+        timeval timeout{1, 0};
+        ::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        ::setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        std::string request;
+        char buffer[1024];
+        while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+            ssize_t n = ::recv(client, buffer, sizeof(buffer), 0);
+            if (n <= 0) break;
+            request.append(buffer, static_cast<size_t>(n));
+        }
+        bool found = request.rfind("GET /metrics ", 0) == 0 || request.rfind("GET / ", 0) == 0;
+        std::string body = found ? render() : "Not found\n";
+        std::string response = std::string(found ? "HTTP/1.1 200 OK\r\n" : "HTTP/1.1 404 Not Found\r\n") +
+                               "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                               "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                               "Connection: close\r\n\r\n" + body;
+        send_all(client, response);
+        ::close(client);
+    }
+#endif
+}
@@ -0,0 +1,263 @@
+// Author: Hossein Taji
+
+#include "MultiBufferHasher.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "picosha2.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MULTI_BUFFER_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TARGET_AVX2
+#define TARGET_AVX512
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+#endif
+
+namespace {
+
+using Words = uint32_t[MultiBufferHasher::kMaxLanes];
+
+// Per-lane view of a message as a sequence of padded 64-byte blocks. Whole
+// blocks are read straight from the caller's buffer; only the final one or
+// two blocks (remainder, 0x80 marker and bit length) live in `tail`.
+struct Lane {
+    const unsigned char* data;
+    size_t full_blocks;
+    size_t total_blocks;
+    unsigned char tail[128];
+
+    void init(const MultiBufferHasher::Message& message) {
+        data = message.data;
+        full_blocks = message.size / 64;
+        size_t remainder = message.size % 64;
+        size_t tail_blocks = remainder + 9 <= 64 ? 1 : 2;
+        total_blocks = full_blocks + tail_blocks;
+
+        std::memset(tail, 0, sizeof(tail));
+        if (remainder) std::memcpy(tail, data + full_blocks * 64, remainder);
+        tail[remainder] = 0x80;
+        uint64_t bit_length = static_cast<uint64_t>(message.size) * 8;
+        unsigned char* length_field = tail + tail_blocks * 64 - 8;
+        for (int i = 0; i < 8; ++i) {
+            length_field[i] = static_cast<unsigned char>(bit_length >> (56 - 8 * i));
+        }
+    }
+
+    const unsigned char* block(size_t index) const {
+        return index < full_blocks ? data + index * 64 : tail + (index - full_blocks) * 64;
+    }
+};
+
+inline uint32_t load_be32(const unsigned char* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+#ifdef MULTI_BUFFER_X86
+
+// ---- AVX2: 8 lanes --------------------------------------------------------
+
+TARGET_AVX2 inline __m256i rotr8(__m256i x, int n) {
+    return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+TARGET_AVX2 inline __m256i add8(__m256i a, __m256i b) { return _mm256_add_epi32(a, b); }
+
+TARGET_AVX2 void compress_avx2(Words* state, const Words* words, unsigned active) {
+    __m256i w[64];
+    for (int t = 0; t < 16; ++t) w[t] = _mm256_load_si256(reinterpret_cast<const __m256i*>(words[t]));
+    for (int t = 16; t < 64; ++t) {
+        __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr8(w[t - 15], 7), rotr8(w[t - 15], 18)),
+                                      _mm256_srli_epi32(w[t - 15], 3));
+        __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr8(w[t - 2], 17), rotr8(w[t - 2], 19)),
+                                      _mm256_srli_epi32(w[t - 2], 10));
+        w[t] = add8(add8(s1, w[t - 7]), add8(s0, w[t - 16]));
+    }
+
+    __m256i initial[8];
+    for (int i = 0; i < 8; ++i) initial[i] = _mm256_load_si256(reinterpret_cast<const __m256i*>(state[i]));
+    __m256i a = initial[0], b = initial[1], c = initial[2], d = initial[3];
+    __m256i e = initial[4], f = initial[5], g = initial[6], h = initial[7];
+
+    for (int t = 0; t < 64; ++t) {
+        __m256i bsig1 = _mm256_xor_si256(_mm256_xor_si256(rotr8(e, 6), rotr8(e, 11)), rotr8(e, 25));
+        __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        __m256i k = _mm256_set1_epi32(static_cast<int>(picosha2::detail::add_constant[t]));
+        __m256i temp1 = add8(add8(add8(h, bsig1), add8(ch, k)), w[t]);
+        __m256i bsig0 = _mm256_xor_si256(_mm256_xor_si256(rotr8(a, 2), rotr8(a, 13)), rotr8(a, 22));
+        __m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+        __m256i temp2 = add8(bsig0, maj);
+        h = g; g = f; f = e;
+        e = add8(d, temp1);
+        d = c; c = b; b = a;
+        a = add8(temp1, temp2);
+    }
+
+    // Lanes whose message has already ended keep their state unchanged.
+    __m256i mask = _mm256_set_epi32(
+        -int((active >> 7) & 1), -int((active >> 6) & 1), -int((active >> 5) & 1), -int((active >> 4) & 1),
+        -int((active >> 3) & 1), -int((active >> 2) & 1), -int((active >> 1) & 1), -int(active & 1));
+    __m256i result[8] = {a, b, c, d, e, f, g, h};
+    for (int i = 0; i < 8; ++i) {
+        __m256i updated = add8(initial[i], _mm256_and_si256(result[i], mask));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(state[i]), updated);
+    }
+}
+
+// ---- AVX-512: 16 lanes ----------------------------------------------------
+
+TARGET_AVX512 inline __m512i add16(__m512i a, __m512i b) { return _mm512_add_epi32(a, b); }
+
+TARGET_AVX512 void compress_avx512(Words* state, const Words* words, unsigned active) {
+    __m512i w[64];
+    for (int t = 0; t < 16; ++t) w[t] = _mm512_load_si512(words[t]);
+    for (int t = 16; t < 64; ++t) {
+        __m512i s0 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(w[t - 15], 7), _mm512_ror_epi32(w[t - 15], 18),
+                                               _mm512_srli_epi32(w[t - 15], 3), 0x96);
+        __m512i s1 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(w[t - 2], 17), _mm512_ror_epi32(w[t - 2], 19),
+                                               _mm512_srli_epi32(w[t - 2], 10), 0x96);
+        w[t] = add16(add16(s1, w[t - 7]), add16(s0, w[t - 16]));
+    }
+
+    __m512i initial[8];
+    for (int i = 0; i < 8; ++i) initial[i] = _mm512_load_si512(state[i]);
+    __m512i a = initial[0], b = initial[1], c = initial[2], d = initial[3];
+    __m512i e = initial[4], f = initial[5], g = initial[6], h = initial[7];
+
+    for (int t = 0; t < 64; ++t) {
+        __m512i bsig1 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(e, 6), _mm512_ror_epi32(e, 11),
+                                                  _mm512_ror_epi32(e, 25), 0x96);
+        __m512i ch = _mm512_ternarylogic_epi32(e, f, g, 0xCA);
+        __m512i k = _mm512_set1_epi32(static_cast<int>(picosha2::detail::add_constant[t]));
+        __m512i temp1 = add16(add16(add16(h, bsig1), add16(ch, k)), w[t]);
+        __m512i bsig0 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(a, 2), _mm512_ror_epi32(a, 13),
+                                                  _mm512_ror_epi32(a, 22), 0x96);
+        __m512i maj = _mm512_ternarylogic_epi32(a, b, c, 0xE8);
+        __m512i temp2 = add16(bsig0, maj);
+        h = g; g = f; f = e;
+        e = add16(d, temp1);
+        d = c; c = b; b = a;
+        a = add16(temp1, temp2);
+    }
+
+    // Lanes whose message has already ended keep their state unchanged.
+    __mmask16 mask = static_cast<__mmask16>(active);
+    __m512i result[8] = {a, b, c, d, e, f, g, h};
+    for (int i = 0; i < 8; ++i) {
+        _mm512_store_si512(state[i], _mm512_mask_add_epi32(initial[i], mask, initial[i], result[i]));
+    }
+}
+
+bool cpu_supports(MultiBufferHasher::Impl impl) {
+#if defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7) return false;
+    __cpuid(regs, 1);
+    if (!((regs[2] >> 27) & 1)) return false;  // OSXSAVE
+    unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(regs, 7, 0);
+    if (impl == MultiBufferHasher::Impl::avx2) return ((xcr0 & 0x6) == 0x6) && ((regs[1] >> 5) & 1);
+    return ((xcr0 & 0xe6) == 0xe6) && ((regs[1] >> 16) & 1);
+#else
+    __builtin_cpu_init();
+    if (impl == MultiBufferHasher::Impl::avx2) return __builtin_cpu_supports("avx2");
+    return __builtin_cpu_supports("avx512f");
+#endif
+}
+
+#endif  // MULTI_BUFFER_X86
+
+}  // namespace
+
+MultiBufferHasher::Impl MultiBufferHasher::detect() {
+    if (supported(Impl::avx512)) return Impl::avx512;
+    if (supported(Impl::avx2)) return Impl::avx2;
+    return Impl::none;
+}
+
+bool MultiBufferHasher::supported(Impl impl) {
+    if (impl == Impl::none) return true;
+#ifdef MULTI_BUFFER_X86
+    return cpu_supports(impl);
+#else
+    return false;
+#endif
+}
+
+const char* MultiBufferHasher::name(Impl impl) {
+    switch (impl) {
+        case Impl::avx2: return "avx2";
+        case Impl::avx512: return "avx512";
+        default: return "off";
+    }
+}
+
+MultiBufferHasher::MultiBufferHasher(Impl impl) : impl_(supported(impl) ? impl : Impl::none) {}
+
+size_t MultiBufferHasher::lanes() const {
+    switch (impl_) {
+        case Impl::avx2: return 8;
+        case Impl::avx512: return 16;
+        default: return 1;
+    }
+}
+
+void MultiBufferHasher::hash(const Message* messages, size_t count, Digest* digests) const {
+#ifdef MULTI_BUFFER_X86
+    // More messages than lanes: hash them in lane-sized groups.
+    if (impl_ != Impl::none && count > lanes()) {
+        for (size_t first = 0; first < count; first += lanes()) {
+            hash(messages + first, std::min(lanes(), count - first), digests + first);
+        }
+        return;
+    }
+    if (impl_ != Impl::none && count > 1) {
+        Lane lanes_state[kMaxLanes];
+        size_t max_blocks = 0;
+        for (size_t l = 0; l < count; ++l) {
+            lanes_state[l].init(messages[l]);
+            max_blocks = std::max(max_blocks, lanes_state[l].total_blocks);
+        }
+
+        alignas(64) Words state[8];
+        alignas(64) Words words[16];
+        for (int i = 0; i < 8; ++i) {
+            std::fill(state[i], state[i] + kMaxLanes, static_cast<uint32_t>(picosha2::detail::initial_message_digest[i]));
+        }
+        for (int t = 0; t < 16; ++t) std::fill(words[t], words[t] + kMaxLanes, 0u);
+
+        for (size_t step = 0; step < max_blocks; ++step) {
+            unsigned active = 0;
+            for (size_t l = 0; l < count; ++l) {
+                if (step >= lanes_state[l].total_blocks) continue;
+                active |= 1u << l;
+                const unsigned char* block = lanes_state[l].block(step);
+                for (int t = 0; t < 16; ++t) words[t][l] = load_be32(block + t * 4);
+            }
+            if (impl_ == Impl::avx512) compress_avx512(state, words, active);
+            else compress_avx2(state, words, active);
+        }
+
+        for (size_t l = 0; l < count; ++l) {
+            for (int i = 0; i < 8; ++i) {
+                for (int byte = 0; byte < 4; ++byte) {
+                    digests[l][i * 4 + byte] = static_cast<unsigned char>(state[i][l] >> (24 - 8 * byte));
+                }
+            }
+        }
+        return;
+    }
+#endif
+    // Scalar fallback: hash each message on its own.
+    for (size_t l = 0; l < count; ++l) {
+        picosha2::hash256(messages[l].data, messages[l].data + messages[l].size, digests[l].begin(), digests[l].end());
+    }
+}
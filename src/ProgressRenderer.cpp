@@ -0,0 +1,118 @@
+// Author: Hossein Taji
+
+#include "ProgressRenderer.h"
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+const int kBarWidth = 50;
+// Weight of the newest sample in the smoothed rates.
+const double kSmoothing = 0.3;
+
+std::string format_duration(double seconds) {
+    long total = static_cast<long>(seconds + 0.5);
+    std::ostringstream out;
+    if (total >= 3600) out << total / 3600 << "h";
+    out << (total % 3600) / 60 << "m" << (total % 60 < 10 ? "0" : "") << total % 60 << "s";
+    return out.str();
+}
+}
+
+bool ProgressRenderer::stdout_is_terminal() {
+#ifdef _WIN32
+    return _isatty(_fileno(stdout)) != 0;
+#else
+    return isatty(fileno(stdout)) != 0;
+#endif
+}
+
+ProgressRenderer::ProgressRenderer(Counters counters, std::mutex& output_mutex, std::chrono::milliseconds interval)
+    : counters_(counters), output_mutex_(output_mutex), interval_(interval), enabled_(stdout_is_terminal()),
+      start_(std::chrono::steady_clock::now()), last_sample_(start_) {
+    if (enabled_) thread_ = std::thread([this] { run(); });
+}
+
+ProgressRenderer::~ProgressRenderer() {
+    stop();
+}
+
+void ProgressRenderer::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) return;
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    if (!thread_.joinable()) return;
+    thread_.join();
+    render(true);
+}
+
+void ProgressRenderer::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!wake_.wait_for(lock, interval_, [this] { return stopping_; })) {
+        lock.unlock();
+        render(false);
+        lock.lock();
+    }
+}
+
+void ProgressRenderer::render(bool final) {
+    int processed = counters_.processed_files.load(std::memory_order_relaxed);
+    int discovered = counters_.discovered_files.load(std::memory_order_relaxed);
+    uint64_t bytes = counters_.processed_bytes.load(std::memory_order_relaxed);
+    bool complete = counters_.discovery_complete.load(std::memory_order_relaxed);
+    if (discovered == 0 && !drawn_) return;
+
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - last_sample_).count();
+    if (final) {
+        // The last line reports the averages over the whole run.
+        double total = std::chrono::duration<double>(now - start_).count();
+        files_rate_ = total > 0 ? processed / total : 0;
+        bytes_rate_ = total > 0 ? bytes / total : 0;
+    } else if (elapsed > 0) {
+        double weight = drawn_ ? kSmoothing : 1.0;
+        files_rate_ += weight * ((processed - last_files_) / elapsed - files_rate_);
+        bytes_rate_ += weight * ((bytes - last_bytes_) / elapsed - bytes_rate_);
+    }
+    last_sample_ = now;
+    last_files_ = processed;
+    last_bytes_ = bytes;
+
+    std::ostringstream line;
+    line << '\r';
+    if (complete) {
+        double fraction = discovered ? static_cast<double>(processed) / discovered : 1.0;
+        int position = static_cast<int>(kBarWidth * fraction);
+        line << '[';
+        for (int i = 0; i < kBarWidth; ++i) line << (i < position ? '=' : i == position ? '>' : ' ');
+        line << "] " << static_cast<int>(fraction * 100) << "% (" << processed << "/" << discovered << ")";
+    } else {
+        line << "Hashed " << processed << " / discovered " << discovered << " files";
+    }
+    line.setf(std::ios::fixed);
+    line.precision(1);
+    line << "  " << files_rate_ << " files/s  " << bytes_rate_ / (1024 * 1024) << " MB/s";
+    if (complete && !final && processed < discovered && files_rate_ > 0) {
+        line << "  ETA " << format_duration((discovered - processed) / files_rate_);
+    }
+    std::string text = line.str();
+    // Blank out whatever is left of a longer previous line.
+    size_t length = text.size();
+    if (length < last_length_) text.append(last_length_ - length, ' ');
+    last_length_ = length;
+    if (final) text += '\n';
+
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    std::cout << text << std::flush;
+    drawn_ = true;
+}
@@ -0,0 +1,95 @@
+// Author: Hossein Taji
+
+#include "ReportWriter.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+ReportWriter::~ReportWriter() {
+    close();
+}
+
+bool ReportWriter::open(const std::filesystem::path& path, std::chrono::seconds sync_interval, size_t max_pending) {
+    file_ = std::fopen(path.string().c_str(), "wb");
+    if (!file_) return false;
+    // Batches are already large; stdio buffering would only add a copy.
+    std::setvbuf(file_, nullptr, _IONBF, 0);
+    sync_interval_ = sync_interval;
+    max_pending_ = max_pending ? max_pending : 1;
+    thread_ = std::thread([this] { run(); });
+    return true;
+}
+
+void ReportWriter::write(std::string batch) {
+    if (batch.empty()) return;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this] { return pending_.size() < max_pending_; });
+        pending_.push_back(std::move(batch));
+    }
+    not_empty_.notify_one();
+}
+
+bool ReportWriter::close() {
+    if (!file_) return !failed_;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closing_ = true;
+    }
+    not_empty_.notify_one();
+    thread_.join();
+    if (!sync()) failed_ = true;
+    if (std::fclose(file_) != 0) failed_ = true;
+    file_ = nullptr;
+    return !failed_;
+}
+
+bool ReportWriter::sync() {
+#ifdef _WIN32
+    return _commit(_fileno(file_)) == 0;
+#else
+    return fsync(fileno(file_)) == 0;
+#endif
+}
+
+void ReportWriter::run() {
+    auto last_sync = std::chrono::steady_clock::now();
+    bool dirty = false;  // written since the last fsync
+    auto ready = [this] { return closing_ || !pending_.empty(); };
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        if (dirty && sync_interval_.count() > 0) {
+            // Sync on schedule even when no more results arrive.
+            if (!not_empty_.wait_until(lock, last_sync + sync_interval_, ready)) {
+                lock.unlock();
+                bool ok = sync();
+                lock.lock();
+                if (!ok) failed_ = true;
+                dirty = false;
+                last_sync = std::chrono::steady_clock::now();
+                continue;
+            }
+        } else {
+            not_empty_.wait(lock, ready);
+        }
+        if (pending_.empty()) return;  // closing and drained
+        std::string batch = std::move(pending_.front());
+        pending_.pop_front();
+        lock.unlock();
+        not_full_.notify_one();
+
+        bool ok = std::fwrite(batch.data(), 1, batch.size(), file_) == batch.size();
+        dirty = true;
+        if (ok && sync_interval_.count() > 0 && std::chrono::steady_clock::now() - last_sync >= sync_interval_) {
+            ok = sync();
+            dirty = false;
+            last_sync = std::chrono::steady_clock::now();
+        }
+
+        lock.lock();
+        if (!ok) failed_ = true;
+    }
+}
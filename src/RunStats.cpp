@@ -0,0 +1,112 @@
+// Author: Hossein Taji
+
+#include "RunStats.h"
+
+#include <iomanip>
+
+namespace {
+const char* const kSizeClassNames[RunStats::kSizeClasses] = {"< 4 KB", "< 64 KB", "< 1 MB", "< 16 MB", "< 256 MB", ">= 256 MB"};
+const char* const kLatencyBucketNames[RunStats::kLatencyBuckets] = {"<100us", "<1ms", "<10ms", "<100ms", "<1s", "<10s", ">=10s"};
+
+size_t size_class(uint64_t size) {
+    size_t index = 0;
+    for (uint64_t bound = 4096; index + 1 < RunStats::kSizeClasses && size >= bound; bound *= 16) ++index;
+    return index;
+}
+
+size_t latency_bucket(int64_t ns) {
+    size_t index = 0;
+    for (int64_t bound = 100000; index + 1 < RunStats::kLatencyBuckets && ns >= bound; bound *= 10) ++index;
+    return index;
+}
+
+double per_second(double amount, double seconds) {
+    return seconds > 0 ? amount / seconds : 0;
+}
+}
+
+RunStats::Thread& RunStats::this_thread() {
+    // Cached per thread; the owner check keeps a second instance correct.
+    thread_local const RunStats* owner = nullptr;
+    thread_local Thread* thread = nullptr;
+    if (owner != this) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        threads_.push_back(std::make_unique<Thread>());
+        thread = threads_.back().get();
+        owner = this;
+    }
+    return *thread;
+}
+
+void RunStats::record(uint64_t size, int64_t queued_ns, int64_t start_ns, int64_t end_ns) {
+    Thread& thread = this_thread();
+    size_t index = size_class(size);
+    ++thread.files;
+    thread.bytes += size;
+    ++thread.class_files[index];
+    ++thread.latency_counts[index][latency_bucket(end_ns - start_ns)];
+    thread.latency_ns[index] += end_ns - start_ns;
+    thread.wait_ns[index] += start_ns - queued_ns;
+}
+
+void RunStats::print(std::ostream& out, const Phases& phases, uint64_t bytes_read,
+                     const std::vector<ThreadPool::WorkerStats>& workers) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Thread total;
+    for (const auto& thread : threads_) {
+        total.files += thread->files;
+        total.bytes += thread->bytes;
+        for (size_t c = 0; c < kSizeClasses; ++c) {
+            total.class_files[c] += thread->class_files[c];
+            total.latency_ns[c] += thread->latency_ns[c];
+            total.wait_ns[c] += thread->wait_ns[c];
+            for (size_t b = 0; b < kLatencyBuckets; ++b) total.latency_counts[c][b] += thread->latency_counts[c][b];
+        }
+    }
+
+    out << std::fixed << std::setprecision(3);
+    out << "--- Statistics ---" << std::endl;
+    out << "Wall time: discovery " << phases.discovery << " s, hashing " << phases.hashing
+        << " s (from the start of discovery), report " << phases.report << " s" << std::endl;
+    out << std::setprecision(1);
+    out << "Read " << bytes_read / 1e6 << " MB; hashed " << total.files << " files: "
+        << per_second(bytes_read / 1e6, phases.hashing) << " MB/s, " << per_second(total.files, phases.hashing) << " files/s" << std::endl;
+
+    // Files are counted on the thread that finished them.
+    out << "Per thread (over the hashing time):" << std::endl;
+    out << "  thread      files         MB      MB/s   files/s" << std::endl;
+    for (size_t i = 0; i < threads_.size(); ++i) {
+        const Thread& thread = *threads_[i];
+        out << "  " << std::setw(6) << i << std::setw(11) << thread.files << std::setw(11) << thread.bytes / 1e6
+            << std::setw(10) << per_second(thread.bytes / 1e6, phases.hashing)
+            << std::setw(10) << per_second(thread.files, phases.hashing) << std::endl;
+    }
+
+    // Busy workers with long queue waits point at too few threads; idle
+    // workers at I/O or discovery not keeping up.
+    out << "Pool workers:" << std::endl;
+    out << "  worker      tasks     steals    busy    idle" << std::endl;
+    for (size_t i = 0; i < workers.size(); ++i) {
+        const ThreadPool::WorkerStats& worker = workers[i];
+        double lifetime = static_cast<double>(worker.busy_ns + worker.idle_ns);
+        out << "  " << std::setw(6) << i << std::setw(11) << worker.tasks << std::setw(11) << worker.steals
+            << std::setw(7) << (lifetime > 0 ? 100.0 * worker.busy_ns / lifetime : 0) << "%"
+            << std::setw(7) << (lifetime > 0 ? 100.0 * worker.idle_ns / lifetime : 0) << "%" << std::endl;
+    }
+
+    out << "Queue wait and hashing latency per file, by size:" << std::endl;
+    out << "  size          files  wait(ms)   lat(ms)";
+    for (const char* name : kLatencyBucketNames) out << std::setw(8) << name;
+    out << std::endl << std::setprecision(2);
+    for (size_t c = 0; c < kSizeClasses; ++c) {
+        uint64_t files = total.class_files[c];
+        if (files == 0) continue;
+        out << "  " << std::left << std::setw(10) << kSizeClassNames[c] << std::right << std::setw(9) << files
+            << std::setw(10) << total.wait_ns[c] / 1e6 / files << std::setw(10) << total.latency_ns[c] / 1e6 / files;
+        for (size_t b = 0; b < kLatencyBuckets; ++b) out << std::setw(8) << total.latency_counts[c][b];
+        out << std::endl;
+    }
+    out << "------------------" << std::endl;
+    out.unsetf(std::ios::floatfield);
+    out << std::setprecision(6);
+}
@@ -2,61 +2,241 @@
 
 #include "ThreadPool.h"
 
-ThreadPool::ThreadPool(size_t num_threads) : stop(false) {
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+#include "Trace.h"
+
+namespace {
+// How many times an idle worker looks for work before going to sleep.
+const int kSpinAttempts = 64;
+
+// The pool whose worker is running on this thread, if any, and its index.
+thread_local ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+// This worker's counters, when the pool collects them.
+thread_local ThreadPool::WorkerStats* current_stats = nullptr;
+
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Cheap per-thread random numbers for picking steal victims.
+size_t next_random() {
+    thread_local unsigned long long state = std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return static_cast<size_t>(state);
+}
+
+// Deques hold pointers, so spawned tasks live in heap nodes. Finished nodes
+// go back to the free list of whichever thread ran them and are reused by
+// its next spawn; the list is capped so a thread that mostly steals does not
+// hoard them.
+const size_t kMaxCachedNodes = 4096;
+
+struct NodeCache {
+    std::vector<Task*> free;
+    ~NodeCache() {
+        for (Task* node : free) delete node;
+    }
+};
+
+thread_local NodeCache node_cache;
+
+Task* acquire_node(Task&& task) {
+    if (node_cache.free.empty()) return new Task(std::move(task));
+    Task* node = node_cache.free.back();
+    node_cache.free.pop_back();
+    *node = std::move(task);
+    return node;
+}
+
+// Take the task out of a node and recycle the node.
+void release_node(Task* node, Task& task) {
+    task = std::move(*node);
+    if (node_cache.free.size() < kMaxCachedNodes) {
+        node_cache.free.push_back(node);
+    } else {
+        delete node;
+    }
+}
+}
+
+ThreadPool::ThreadPool(size_t num_threads, size_t queue_capacity, std::vector<WorkerStats>* stats)
+    : tasks(queue_capacity), stop(false), stats(stats), busy(new BusyFlag[num_threads]) {
+    if (stats) stats->assign(num_threads, WorkerStats());
+    for (size_t i = 0; i < num_threads; ++i) {
+        local_tasks.emplace_back(new WorkStealingDeque<Task*>());
+    }
     // Create and launch the specified number of worker threads.
     for (size_t i = 0; i < num_threads; ++i) {
-        workers.emplace_back([this] { this->worker(); });
+        workers.emplace_back([this, i] { this->worker(i); });
     }
 }
 
 ThreadPool::~ThreadPool() {
-    // Lock the queue and set the stop flag.
-    {
-        std::unique_lock<std::mutex> lock(queue_mutex);
-        stop = true;
-    }
+    shutdown();
+}
 
-    // Wake up all threads so they can check the stop flag.
-    condition.notify_all();
+void ThreadPool::shutdown() {
+    // Set the stop flag and wake up all threads so they can check it.
+    stop.store(true, std::memory_order_release);
+    not_empty.notify_all();
 
     // Wait for all threads to complete their work and exit.
     for (std::thread &worker : workers) {
-        worker.join();
+        if (worker.joinable()) worker.join();
     }
 }
 
-void ThreadPool::enqueue(std::function<void()> task) {
-    // Lock the queue to safely add the new task.
+size_t ThreadPool::queued_tasks() const {
+    size_t queued = tasks.size_approx() + prioritized_count.load(std::memory_order_relaxed);
+    for (const auto& deque : local_tasks) queued += deque->size_approx();
+    return queued;
+}
+
+size_t ThreadPool::active_workers() const {
+    size_t active = 0;
+    for (size_t i = 0; i < workers.size(); ++i) active += busy[i].busy.load(std::memory_order_relaxed);
+    return active;
+}
+
+void ThreadPool::enqueue(Task task) {
+    while (!tasks.try_push(task)) {
+        // A worker blocking here could wait forever on itself; run it inline.
+        if (current_pool == this) {
+            task();
+            return;
+        }
+        EventCount::Key key = not_full.prepare_wait();
+        if (tasks.try_push(task)) {
+            not_full.cancel_wait();
+            break;
+        }
+        not_full.wait(key);
+    }
+    // Wake one sleeping worker, if there is one.
+    not_empty.notify_one();
+}
+
+void ThreadPool::enqueue(Task task, uint64_t priority) {
     {
-        std::unique_lock<std::mutex> lock(queue_mutex);
-        // std::move is a way to avoid making unnecessary copies of objects.
-        tasks.push(std::move(task));
+        std::lock_guard<std::mutex> lock(prioritized_mutex);
+        prioritized.push_back({priority, prioritized_sequence++, std::move(task)});
+        std::push_heap(prioritized.begin(), prioritized.end());
+        prioritized_count.store(prioritized.size(), std::memory_order_release);
     }
-    // Notify one waiting thread that a task is available.
-    condition.notify_one();
+    not_empty.notify_one();
 }
 
-void ThreadPool::worker() {
-    while (true) {
-        std::function<void()> task;
+bool ThreadPool::pop_prioritized(Task& task) {
+    if (prioritized_count.load(std::memory_order_acquire) == 0) return false;
+    std::lock_guard<std::mutex> lock(prioritized_mutex);
+    if (prioritized.empty()) return false;
+    std::pop_heap(prioritized.begin(), prioritized.end());
+    task = std::move(prioritized.back().task);
+    prioritized.pop_back();
+    prioritized_count.store(prioritized.size(), std::memory_order_release);
+    return true;
+}
+
+void ThreadPool::spawn(Task task) {
+    if (current_pool != this) {
+        enqueue(std::move(task));
+        return;
+    }
+    local_tasks[current_worker]->push(acquire_node(std::move(task)));
+    // Let a sleeping worker come and steal it.
+    not_empty.notify_one();
+}
 
-        // Lock the queue to wait for and retrieve a task.
-        {
-            std::unique_lock<std::mutex> lock(queue_mutex);
+bool ThreadPool::steal(size_t thief, Task& task) {
+    const size_t count = local_tasks.size();
+    size_t start = next_random() % count;
+    for (size_t i = 0; i < count; ++i) {
+        size_t victim = (start + i) % count;
+        if (victim == thief) continue;
+        Task* stolen;
+        if (local_tasks[victim]->steal(stolen)) {
+            release_node(stolen, task);
+            if (current_stats) ++current_stats->steals;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::find_task(size_t index, Task& task) {
+    Task* local;
+    if (local_tasks[index]->pop(local)) {
+        release_node(local, task);
+        return true;
+    }
+    if (pop_prioritized(task)) return true;
+    if (tasks.try_pop(task)) {
+        not_full.notify_one();
+        return true;
+    }
+    return steal(index, task);
+}
 
-            // Wait until a task is available or the pool is stopped.
-            condition.wait(lock, [this] { return this->stop || !this->tasks.empty(); });
+void ThreadPool::worker(size_t index) {
+    current_pool = this;
+    current_worker = index;
+    WorkerStats counters;
+    if (stats) current_stats = &counters;
+    const int64_t started = stats || Trace::enabled() ? now_ns() : 0;
+    int64_t waiting_since = started;  // end of the last task, for the trace
+    Trace::name_thread("worker " + std::to_string(index));
+    Task task;
+    while (true) {
+        // Spin briefly before sleeping; bursts of tiny tasks never park.
+        bool found = false;
+        for (int attempt = 0; attempt < kSpinAttempts && !found; ++attempt) {
+            found = find_task(index, task);
+            if (!found) std::this_thread::yield();
+        }
 
-            // If the pool is stopped and no tasks are left, exit the thread.
-            if (this->stop && this->tasks.empty()) {
+        if (!found) {
+            EventCount::Key key = not_empty.prepare_wait();
+            found = find_task(index, task);
+            if (found) {
+                not_empty.cancel_wait();
+            } else if (stop.load(std::memory_order_acquire)) {
+                // The pool is stopped and no tasks are left, exit the thread.
+                not_empty.cancel_wait();
+                if (stats) {
+                    counters.idle_ns = now_ns() - started - counters.busy_ns;
+                    (*stats)[index] = counters;
+                    current_stats = nullptr;
+                }
                 return;
+            } else {
+                not_empty.wait(key);
+                continue;
             }
-
-            task = std::move(this->tasks.front());
-            this->tasks.pop();
         }
 
         // Execute the task.
-        task();
+        busy[index].busy.store(true, std::memory_order_relaxed);
+        const bool tracing = Trace::enabled();
+        if (stats || tracing) {
+            int64_t start = now_ns();
+            if (tracing) Trace::record("dequeue wait", waiting_since, start);
+            task();
+            task = nullptr;
+            int64_t end = now_ns();
+            if (tracing) Trace::record("task", start, end);
+            counters.busy_ns += end - start;
+            ++counters.tasks;
+            waiting_since = end;
+        } else {
+            task();
+            task = nullptr;
+        }
+        busy[index].busy.store(false, std::memory_order_relaxed);
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,109 @@
+// Author: Hossein Taji
+
+#include "Trace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+struct Event {
+    const char* name;
+    int64_t start_ns;
+    int64_t duration_ns;
+    int64_t bytes;
+};
+
+std::string json_string(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20) out += c;
+    }
+    return out + "\"";
+}
+
+// One thread's ring. Only the owning thread writes events; `count` is
+// published after each event so the writer can read a consistent prefix.
+struct Buffer {
+    std::unique_ptr<Event[]> events{new Event[Trace::kEventsPerThread]};
+    std::atomic<uint64_t> count{0};
+    size_t tid = 0;
+    std::string name;  // guarded by registry_mutex
+};
+
+// Buffers outlive their threads so workers can exit before the trace is written.
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<Buffer>> registry;
+int64_t origin_ns = 0;
+
+Buffer& this_thread() {
+    thread_local Buffer* buffer = nullptr;
+    if (!buffer) {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.push_back(std::make_unique<Buffer>());
+        buffer = registry.back().get();
+        buffer->tid = registry.size();
+    }
+    return *buffer;
+}
+}
+
+std::atomic<bool> Trace::enabled_{false};
+
+void Trace::start() {
+    origin_ns = now();
+    enabled_.store(true, std::memory_order_relaxed);
+}
+
+int64_t Trace::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace::record(const char* name, int64_t start_ns, int64_t end_ns, int64_t bytes) {
+    Buffer& buffer = this_thread();
+    uint64_t count = buffer.count.load(std::memory_order_relaxed);
+    buffer.events[count % kEventsPerThread] = {name, start_ns, end_ns - start_ns, bytes};
+    buffer.count.store(count + 1, std::memory_order_release);
+}
+
+void Trace::name_thread(const std::string& name) {
+    if (!enabled()) return;
+    Buffer& buffer = this_thread();
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    buffer.name = name;
+}
+
+bool Trace::write(const std::filesystem::path& path, std::string& error) {
+    std::FILE* file = std::fopen(path.string().c_str(), "w");
+    if (!file) { error = "cannot open " + path.string(); return false; }
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    uint64_t dropped = 0;
+    const char* separator = "";
+    std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", file);
+    for (const auto& buffer : registry) {
+        std::string name = buffer->name.empty() ? "thread " + std::to_string(buffer->tid) : buffer->name;
+        std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":%s}}",
+                     separator, buffer->tid, json_string(name).c_str());
+        separator = ",\n";
+        // Only the newest kEventsPerThread spans survive.
+        uint64_t count = buffer->count.load(std::memory_order_acquire);
+        uint64_t first = count > kEventsPerThread ? count - kEventsPerThread : 0;
+        dropped += first;
+        for (uint64_t i = first; i < count; ++i) {
+            const Event& event = buffer->events[i % kEventsPerThread];
+            // Timestamps are in microseconds.
+            std::fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f",
+                         event.name, buffer->tid, (event.start_ns - origin_ns) / 1e3, event.duration_ns / 1e3);
+            if (event.bytes >= 0) std::fprintf(file, ",\"args\":{\"bytes\":%lld}", static_cast<long long>(event.bytes));
+            std::fputc('}', file);
+        }
+    }
+    std::fprintf(file, "\n],\"otherData\":{\"dropped_events\":%llu}}\n", static_cast<unsigned long long>(dropped));
+    bool ok = std::ferror(file) == 0;
+    if (std::fclose(file) != 0) ok = false;
+    if (!ok) error = "cannot write " + path.string();
+    return ok;
+}
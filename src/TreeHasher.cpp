@@ -0,0 +1,110 @@
+// Author: Hossein Taji
+
+#include "TreeHasher.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <system_error>
+
+#include "FileReader.h"
+#include "Trace.h"
+#include "picosha2.h"
+
+namespace {
+const unsigned char kLeafPrefix = 0x00;
+const unsigned char kNodePrefix = 0x01;
+}
+
+struct TreeHasher::File {
+    std::filesystem::path path;
+    uint64_t size;
+    uint64_t chunk_size;
+    std::vector<Digest> leaves;
+    std::atomic<size_t> remaining;
+    std::atomic<bool> failed{false};
+    std::atomic<uint64_t>* hashed_bytes;
+    DoneCallback on_done;
+
+    File(std::filesystem::path path, uint64_t size, uint64_t chunk_size, size_t chunks,
+         std::atomic<uint64_t>* hashed_bytes, DoneCallback on_done)
+        : path(std::move(path)), size(size), chunk_size(chunk_size), leaves(chunks), remaining(chunks),
+          hashed_bytes(hashed_bytes), on_done(std::move(on_done)) {}
+};
+
+TreeHasher::TreeHasher(ThreadPool& pool, uint64_t chunk_size, std::atomic<uint64_t>* hashed_bytes)
+    : pool_(pool), chunk_size_(std::max<uint64_t>(chunk_size, 1)), hashed_bytes_(hashed_bytes) {}
+
+std::string TreeHasher::label(uint64_t chunk_size) {
+    std::string size;
+    if (chunk_size % (1 << 20) == 0) size = std::to_string(chunk_size >> 20) + "M";
+    else if (chunk_size % (1 << 10) == 0) size = std::to_string(chunk_size >> 10) + "K";
+    else size = std::to_string(chunk_size);
+    return "sha256-tree-" + size;
+}
+
+TreeHasher::Digest TreeHasher::root(const Digest* leaves, size_t count) {
+    Digest digest;
+    if (count == 0) {
+        picosha2::hash256_one_by_one hasher;
+        hasher.finish();
+        hasher.get_hash_bytes(digest.begin(), digest.end());
+        return digest;
+    }
+    if (count == 1) return leaves[0];
+    size_t split = 1;
+    while (split * 2 < count) split *= 2;
+    Digest left = root(leaves, split);
+    Digest right = root(leaves + split, count - split);
+    picosha2::hash256_one_by_one hasher;
+    hasher.process(&kNodePrefix, &kNodePrefix + 1);
+    hasher.process(left.data(), left.data() + left.size());
+    hasher.process(right.data(), right.data() + right.size());
+    hasher.finish();
+    hasher.get_hash_bytes(digest.begin(), digest.end());
+    return digest;
+}
+
+bool TreeHasher::hash_chunk(const File& file, size_t index, Digest& digest) {
+    // Chunks are read with plain reads; they are too small to be worth a mapping.
+    thread_local FileReader reader;
+    picosha2::hash256_one_by_one hasher;
+    hasher.process(&kLeafPrefix, &kLeafPrefix + 1);
+    uint64_t offset = index * file.chunk_size;
+    uint64_t length = std::min(file.chunk_size, file.size - offset);
+    uint64_t hashed = 0;
+    bool ok = reader.read_range(file.path, offset, length, [&](const unsigned char* data, size_t size) {
+        Trace::Span span("hash", static_cast<int64_t>(size));
+        hasher.process(data, data + size);
+        hashed += size;
+    });
+    // A file that shrank under us cannot produce a meaningful digest.
+    if (file.hashed_bytes) file.hashed_bytes->fetch_add(hashed, std::memory_order_relaxed);
+    if (!ok || hashed != length) return false;
+    hasher.finish();
+    hasher.get_hash_bytes(digest.begin(), digest.end());
+    return true;
+}
+
+void TreeHasher::hash(const std::filesystem::path& path, DoneCallback on_done) const {
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(path, ec);
+    if (ec) {
+        on_done(false, Digest{}, 0);
+        return;
+    }
+    size_t chunks = static_cast<size_t>((size + chunk_size_ - 1) / chunk_size_);
+    auto file = std::make_shared<File>(path, size, chunk_size_, chunks, hashed_bytes_, std::move(on_done));
+    if (chunks <= 1) {
+        bool ok = chunks == 0 || hash_chunk(*file, 0, file->leaves[0]);
+        file->on_done(ok, ok ? root(file->leaves.data(), chunks) : Digest{}, file->size);
+        return;
+    }
+
+    pool_.enqueue_range(0, chunks, [file](size_t index) {
+        if (!hash_chunk(*file, index, file->leaves[index])) file->failed = true;
+        if (--file->remaining > 0) return;
+        bool ok = !file->failed;
+        file->on_done(ok, ok ? root(file->leaves.data(), file->leaves.size()) : Digest{}, file->size);
+    });
+}
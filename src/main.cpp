@@ -13,49 +13,512 @@
 #include <filesystem>
 #include <atomic>
 #include <algorithm>
+#include <cstdint>
+#include <chrono>
+#include <condition_variable>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <unordered_map>
 #include <unordered_set>
+#include <memory>
+#include <optional>
 #include <utility>
 
 #include "picosha2.h"
+#include "FileReader.h"
+#ifndef _WIN32
+#include "AsyncReader.h"
+#endif
+#include "DirectoryWalker.h"
+#include "HashCache.h"
+#include "Journal.h"
+#include "Manifest.h"
+#include "MetricsExporter.h"
+#include "MultiBufferHasher.h"
+#include "ProgressRenderer.h"
+#include "ReportWriter.h"
+#include "RunStats.h"
 #include "ThreadPool.h"
+#include "Trace.h"
+#include "TreeHasher.h"
+
+// A discovered file and its size at discovery time.
+using FileEntry = DirectoryWalker::File;
+
+// Files up to this size are hashed in batches on the multi-buffer engine.
+const std::uintmax_t kSmallFileThreshold = 16 * 1024;
+
+// Small files are collected into windows of this many batches and sorted by
+// size before being split into batches, so lanes in a batch finish together.
+const size_t kSmallFileWindowBatches = 16;
 
 // Shared resources for progress, output, and results.
 std::atomic<int> processed_files_count = 0;
-int total_files = 0;
+std::atomic<int> discovered_files_count = 0;
+std::atomic<bool> discovery_complete = false;
+std::atomic<uint64_t> hashed_bytes_count = 0;  // bumped per block as data is hashed
+std::atomic<int> failed_files_count = 0;  // files that could not be read
 std::mutex cout_mutex;
-std::vector<std::pair<std::filesystem::path, std::string>> results;
-std::mutex results_mutex;
-
-// The main task for processing a single file.
-void process_file(const std::filesystem::path& file_path) {
-    // 1. Hash the file
-    std::ifstream file_stream(file_path, std::ios::binary);
-    if (!file_stream.is_open()) return;
-    std::string hash = picosha2::hash256_hex_string(
-        std::istreambuf_iterator<char>(file_stream),
-        std::istreambuf_iterator<char>()
-    );
-
-    // 2. Store the result
+// Finished hashes. Each thread appends to its own buffer without locking;
+// collect_results() merges them once hashing is over. With --stream the
+// buffer holds formatted report lines instead, handed to report_writer in
+// large batches as it fills, and at least every kStreamFlushInterval.
+using Result = std::pair<std::filesystem::path, std::string>;
+struct ResultBuffer {
+    std::vector<Result> results;
+    std::mutex lines_mutex;  // taken by the owner and the periodic flush
+    std::string lines;
+};
+std::vector<std::unique_ptr<ResultBuffer>> result_buffers;
+std::mutex result_buffers_mutex;  // taken once per thread, for its first result
+std::vector<Result> results;       // the merged report
+std::unique_ptr<ReportWriter> report_writer;
+const size_t kStreamBatchBytes = 256 * 1024;
+const std::chrono::milliseconds kStreamFlushInterval(1000);
+MultiBufferHasher multi_buffer_hasher(MultiBufferHasher::Impl::none);
+FileReader::Mode io_mode = FileReader::Mode::read;
+
+// Digests of unchanged files from earlier runs; null with --no-cache.
+std::unique_ptr<HashCache> hash_cache;
+// False in duplicates mode: it hashes only candidates, and saving that
+// little would prune the cache, so the cache is only read.
+bool update_cache = true;
+// Files finished by earlier, interrupted runs; null without --journal.
+std::unique_ptr<Journal> journal;
+std::atomic<size_t> resumed_files_count = 0;
+const std::chrono::milliseconds kJournalSyncInterval(1000);
+// The digest this run computes, as recorded in the cache: plain SHA-256 or a tree-hash chunk size.
+uint64_t cache_kind = HashCache::kSha256;
+// Written before every digest in the report; names the tree-hash digest.
+std::string digest_prefix;
+
+// Per-file timings for --stats; null without it.
+std::unique_ptr<RunStats> run_stats;
+
+// Timings of the hashing tasks, for the --schedule report (steady clock, ns).
+std::atomic<int64_t> task_busy_ns = 0;
+std::atomic<int64_t> longest_task_ns = 0;
+std::atomic<int64_t> first_task_start_ns = std::numeric_limits<int64_t>::max();
+std::atomic<int64_t> last_task_end_ns = 0;
+
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void store_min(std::atomic<int64_t>& target, int64_t value) {
+    int64_t current = target.load(std::memory_order_relaxed);
+    while (value < current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+}
+
+void store_max(std::atomic<int64_t>& target, int64_t value) {
+    int64_t current = target.load(std::memory_order_relaxed);
+    while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+}
+
+// Run one hashing task and record its duration.
+template <typename Work>
+void run_timed(Work&& work) {
+    int64_t start = now_ns();
+    work();
+    int64_t end = now_ns();
+    task_busy_ns += end - start;
+    store_max(longest_task_ns, end - start);
+    store_min(first_task_start_ns, start);
+    store_max(last_task_end_ns, end);
+}
+
+// This thread's result buffer, registered on first use. Buffers outlive
+// their threads so pool workers can exit before the results are read.
+ResultBuffer& thread_results() {
+    thread_local ResultBuffer* buffer = nullptr;
+    if (!buffer) {
+        std::lock_guard<std::mutex> lock(result_buffers_mutex);
+        result_buffers.push_back(std::make_unique<ResultBuffer>());
+        buffer = result_buffers.back().get();
+    }
+    return *buffer;
+}
+
+// Move every recorded result into `results`, sorted by path so the report
+// does not depend on scheduling. No task may be recording meanwhile.
+void collect_results() {
+    std::lock_guard<std::mutex> lock(result_buffers_mutex);
+    size_t total = 0;
+    for (const auto& buffer : result_buffers) total += buffer->results.size();
+    results.clear();
+    results.reserve(total);
+    for (const auto& buffer : result_buffers) {
+        std::move(buffer->results.begin(), buffer->results.end(), std::back_inserter(results));
+        buffer->results.clear();
+    }
+    std::sort(results.begin(), results.end(), [](const Result& a, const Result& b) { return a.first.native() < b.first.native(); });
+}
+
+// Hand the partly filled streaming batches of every thread to the writer.
+void flush_streamed_results() {
+    std::vector<std::string> batches;
     {
-        std::lock_guard<std::mutex> lock(results_mutex);
-        results.emplace_back(file_path, hash);
+        std::lock_guard<std::mutex> lock(result_buffers_mutex);
+        for (const auto& buffer : result_buffers) {
+            std::lock_guard<std::mutex> lines_lock(buffer->lines_mutex);
+            if (buffer->lines.empty()) continue;
+            batches.push_back(std::move(buffer->lines));
+            buffer->lines.clear();
+        }
     }
+    // The writer may block while its queue is full; hold no lock meanwhile.
+    for (std::string& batch : batches) report_writer->write(std::move(batch));
+}
+
+// Store a finished hash and count it for the progress line.
+void record_result(const std::filesystem::path& file_path, const std::string& hash) {
+    ResultBuffer& buffer = thread_results();
+    if (report_writer) {
+        std::string batch;
+        {
+            std::lock_guard<std::mutex> lock(buffer.lines_mutex);
+            buffer.lines += file_path.string();
+            buffer.lines += ": ";
+            buffer.lines += hash;
+            buffer.lines += '\n';
+            if (buffer.lines.size() >= kStreamBatchBytes) {
+                batch = std::move(buffer.lines);
+                buffer.lines.clear();
+                buffer.lines.reserve(kStreamBatchBytes + 4096);
+            }
+        }
+        if (!batch.empty()) report_writer->write(std::move(batch));
+    } else {
+        buffer.results.emplace_back(file_path, hash);
+    }
+    processed_files_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Report the cached digest of `file_path` if it is unchanged since it was
+// cached. On a miss, `key` is set (when the file could be stat'ed) for
+// record_digest to cache the new digest under.
+bool serve_from_cache(const std::filesystem::path& file_path, std::optional<HashCache::Key>& key) {
+    if (!hash_cache && !journal) return false;
+    HashCache::Key current;
+    if (!HashCache::make_key(file_path, cache_kind, current)) return false;
+    HashCache::Digest digest;
+    if (hash_cache && hash_cache->lookup(current, digest)) {
+        if (journal) journal->append(file_path, {current.size, current.mtime_ns, current.kind, digest});
+        record_result(file_path, digest_prefix + picosha2::bytes_to_hex_string(digest));
+        return true;
+    }
+    key = current;
+    return false;
+}
+
+// Report a freshly computed digest, and cache and journal it unless the file
+// changed while it was being read.
+void record_digest(const std::filesystem::path& file_path, const HashCache::Digest& digest,
+                   const std::optional<HashCache::Key>& key) {
+    HashCache::Key after;
+    if (key && HashCache::make_key(file_path, cache_kind, after) && after == *key) {
+        if (hash_cache && update_cache) hash_cache->insert(*key, digest);
+        if (journal) journal->append(file_path, {key->size, key->mtime_ns, key->kind, digest});
+    }
+    record_result(file_path, digest_prefix + picosha2::bytes_to_hex_string(digest));
+}
 
-    // 3. Update and display progress
-    int current_count = ++processed_files_count;
+// Report the digest journalled by an interrupted run, if the file still has
+// the size and mtime it was hashed at.
+bool serve_from_journal(const std::filesystem::path& file_path) {
+    const Journal::Entry* entry = journal->find(file_path);
+    if (!entry || entry->kind != cache_kind) return false;
+    HashCache::Key current;
+    if (!HashCache::make_key(file_path, cache_kind, current) || current.size != entry->size || current.mtime_ns != entry->mtime_ns) return false;
+    resumed_files_count.fetch_add(1, std::memory_order_relaxed);
+    record_result(file_path, digest_prefix + picosha2::bytes_to_hex_string(entry->digest));
+    return true;
+}
+
+// The main task for processing a single file. `queued_ns` is when it was
+// handed to the pool, for --stats.
+void process_file(const std::filesystem::path& file_path, int64_t queued_ns = 0) {
+    Trace::Span file_span("file");
+    std::optional<HashCache::Key> key;
+    if (serve_from_cache(file_path, key)) return;
+    const int64_t start = run_stats ? now_ns() : 0;
+    // Hash the file, one large block (or mapped window) at a time
+    thread_local FileReader reader(io_mode);
+    picosha2::hash256_one_by_one hasher;
+    uint64_t bytes = 0;
+    bool ok = reader.read(file_path, [&hasher, &bytes](const unsigned char* data, size_t size) {
+        // Not a Span: a fault in a mapped file longjmps out of here, which
+        // must not skip a destructor.
+        const int64_t hash_start = Trace::enabled() ? Trace::now() : 0;
+        hasher.process(data, data + size);
+        bytes += size;
+        hashed_bytes_count.fetch_add(size, std::memory_order_relaxed);
+        if (hash_start) Trace::record("hash", hash_start, Trace::now(), static_cast<int64_t>(size));
+    });
+    if (!ok) { failed_files_count.fetch_add(1, std::memory_order_relaxed); return; }
+    hasher.finish();
+    HashCache::Digest digest;
+    hasher.get_hash_bytes(digest.begin(), digest.end());
+    file_span.set_bytes(static_cast<int64_t>(bytes));
     {
-        std::lock_guard<std::mutex> lock(cout_mutex);
-        float percentage = static_cast<float>(current_count) / total_files * 100.0f;
-        const int bar_width = 50;
-        int pos = static_cast<int>(bar_width * percentage / 100.0);
-        std::cout << "\r[";
-        for (int i = 0; i < bar_width; ++i) {
-            if (i < pos) std::cout << "="; else if (i == pos) std::cout << ">"; else std::cout << " ";
+        Trace::Span span("publish");
+        record_digest(file_path, digest, key);
+    }
+    if (run_stats) run_stats->record(bytes, queued_ns ? queued_ns : start, start, now_ns());
+}
+
+// Task for a batch of small files: read each one fully into memory, then hash
+// them all in lockstep, one file per SIMD lane.
+void process_small_files(const std::vector<std::filesystem::path>& batch, int64_t queued_ns = 0) {
+    const int64_t start = run_stats ? now_ns() : 0;
+    // Small files are always read, never mapped: a mapping costs more than the copy.
+    thread_local FileReader reader;
+    thread_local std::vector<unsigned char> contents[MultiBufferHasher::kMaxLanes];
+    MultiBufferHasher::Message messages[MultiBufferHasher::kMaxLanes];
+    const std::filesystem::path* lane_paths[MultiBufferHasher::kMaxLanes];
+    std::optional<HashCache::Key> keys[MultiBufferHasher::kMaxLanes];
+    size_t lanes = 0;
+    for (const auto& path : batch) {
+        keys[lanes].reset();
+        if (serve_from_cache(path, keys[lanes])) continue;
+        std::vector<unsigned char>& buffer = contents[lanes];
+        buffer.clear();
+        bool ok = reader.read(path, [&buffer](const unsigned char* data, size_t size) {
+            buffer.insert(buffer.end(), data, data + size);
+        });
+        if (!ok) { failed_files_count.fetch_add(1, std::memory_order_relaxed); continue; }
+        messages[lanes] = {buffer.data(), buffer.size()};
+        hashed_bytes_count.fetch_add(buffer.size(), std::memory_order_relaxed);
+        lane_paths[lanes++] = &path;
+    }
+
+    MultiBufferHasher::Digest digests[MultiBufferHasher::kMaxLanes];
+    {
+        Trace::Span span("hash batch");
+        multi_buffer_hasher.hash(messages, lanes, digests);
+    }
+    const int64_t end = run_stats ? now_ns() : 0;
+    Trace::Span span("publish");
+    for (size_t i = 0; i < lanes; ++i) {
+        record_digest(*lane_paths[i], digests[i], keys[i]);
+        if (run_stats) run_stats->record(messages[i].size, queued_ns ? queued_ns : start, start, end);
+    }
+}
+
+// Hash `message` through the active kernel, feeding it in uneven pieces so the
+// partial-block path is exercised as well as the bulk path.
+std::string hash_with_active_kernel(const std::string& message) {
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(message.data());
+    picosha2::hash256_one_by_one hasher;
+    size_t offset = 0, piece = 1;
+    while (offset < message.size()) {
+        size_t size = std::min(piece, message.size() - offset);
+        hasher.process(data + offset, data + offset + size);
+        offset += size;
+        piece = piece * 3 + 7;
+    }
+    hasher.finish();
+    return picosha2::get_hash_hex_string(hasher);
+}
+
+// Check every SHA-256 kernel supported on this CPU against the FIPS 180-2
+// test vectors and against the scalar kernel on pseudo-random input.
+bool run_self_test() {
+    const std::pair<std::string, std::string> vectors[] = {
+        {"", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+        {"abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+        {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+         "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+        {std::string(1000000, 'a'), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"},
+    };
+    std::string random_message(1 << 20, '\0');
+    unsigned int seed = 12345;
+    for (char& c : random_message) { seed = seed * 1103515245u + 12345u; c = static_cast<char>(seed >> 24); }
+
+    const picosha2::block_impl original = picosha2::current_block_impl();
+    picosha2::set_block_impl(picosha2::block_impl::scalar);
+    const std::string random_reference = hash_with_active_kernel(random_message);
+
+    bool all_passed = true;
+    for (picosha2::block_impl impl : {picosha2::block_impl::scalar, picosha2::block_impl::shani}) {
+        std::cout << "  " << picosha2::block_impl_name(impl) << ": ";
+        if (!picosha2::set_block_impl(impl)) { std::cout << "not supported on this CPU" << std::endl; continue; }
+        bool passed = hash_with_active_kernel(random_message) == random_reference;
+        for (const auto& vector : vectors) {
+            passed = passed && hash_with_active_kernel(vector.first) == vector.second;
+        }
+        std::cout << (passed ? "PASS" : "FAIL") << std::endl;
+        all_passed = all_passed && passed;
+    }
+    picosha2::set_block_impl(original);
+    return all_passed;
+}
+
+struct CheckCounts {
+    size_t ok = 0;
+    size_t failed = 0;
+    size_t missing = 0;
+};
+
+// Compare the results against `manifest` and write one OK / FAILED / MISSING
+// line per entry, in manifest order.
+CheckCounts report_check(const Manifest& manifest, std::ostream& out) {
+    const auto& entries = manifest.entries();
+    std::vector<const std::string*> computed(entries.size(), nullptr);
+    for (const auto& result : results) {
+        size_t index = manifest.find(result.first);
+        if (index != Manifest::npos) computed[index] = &result.second;
+    }
+    CheckCounts counts;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const char* status;
+        if (computed[i]) {
+            bool match = *computed[i] == entries[i].expected;
+            status = match ? "OK" : "FAILED";
+            ++(match ? counts.ok : counts.failed);
+        } else {
+            // Listed but never hashed: gone, or present but unreadable.
+            std::error_code ec;
+            bool exists = std::filesystem::exists(entries[i].path, ec);
+            status = exists ? "FAILED open or read" : "MISSING";
+            ++(exists ? counts.failed : counts.missing);
+        }
+        out << entries[i].path << ": " << status << "\n";
+    }
+    out << std::flush;
+    return counts;
+}
+
+// Run fn(i) for every i in [0, count) on the pool and wait until all are done.
+// Must not be called from a pool worker.
+template <typename F>
+void run_on_pool(ThreadPool& pool, size_t count, F fn) {
+    std::atomic<size_t> remaining{count};
+    std::mutex mutex;
+    std::condition_variable done;
+    pool.enqueue_range(0, count, [&](size_t i) {
+        fn(i);
+        if (--remaining == 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            done.notify_all();
+        }
+    });
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return remaining == 0; });
+}
+
+// Bytes hashed from each end of a file to tell same-size files apart cheaply.
+const std::uintmax_t kPartialHashBytes = 4 * 1024;
+
+// SHA-256 of the first and last kPartialHashBytes of a file. Files short
+// enough to be covered completely are hashed whole, and `complete` is set:
+// their partial hash is the real digest. Empty on a read error or when the
+// file no longer has its discovered size.
+std::string partial_hash(const FileEntry& file, bool& complete) {
+    thread_local FileReader reader;
+    picosha2::hash256_one_by_one hasher;
+    std::uintmax_t bytes = 0;
+    auto consume = [&hasher, &bytes](const unsigned char* data, size_t size) {
+        hasher.process(data, data + size);
+        bytes += size;
+    };
+    complete = file.size <= 2 * kPartialHashBytes;
+    bool ok = complete ? reader.read(file.path, consume)
+                       : reader.read_range(file.path, 0, kPartialHashBytes, consume) &&
+                         reader.read_range(file.path, file.size - kPartialHashBytes, kPartialHashBytes, consume);
+    // A short read means the file changed size since discovery.
+    if (!ok || bytes != std::min(file.size, 2 * kPartialHashBytes)) return {};
+    hasher.finish();
+    return picosha2::get_hash_hex_string(hasher);
+}
+
+struct DuplicateGroup {
+    std::uintmax_t size;
+    std::string hash;
+    std::vector<std::filesystem::path> paths;
+};
+
+// Find groups of identical files in three stages, each reading more of fewer
+// files: equal sizes, then equal partial hashes, then equal full hashes (via
+// process_file). Empty files are ignored. Adds the bytes read to `bytes_read`.
+std::vector<DuplicateGroup> find_duplicates(ThreadPool& pool, const std::vector<FileEntry>& files, std::uintmax_t& bytes_read) {
+    // 1. Only files sharing a size can be equal.
+    std::unordered_map<std::uintmax_t, std::vector<size_t>> by_size;
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (files[i].size != 0 && files[i].size != DirectoryWalker::kUnknownSize) by_size[files[i].size].push_back(i);
+    }
+    std::vector<size_t> candidates;
+    for (const auto& group : by_size) {
+        if (group.second.size() > 1) candidates.insert(candidates.end(), group.second.begin(), group.second.end());
+    }
+    std::cout << files.size() << " files found, " << candidates.size() << " share their size with another file." << std::endl;
+
+    // 2. Hash both ends of every candidate.
+    std::vector<std::string> partial(candidates.size());
+    std::unique_ptr<bool[]> complete(new bool[candidates.size()]());
+    run_on_pool(pool, candidates.size(), [&](size_t k) { partial[k] = partial_hash(files[candidates[k]], complete[k]); });
+    std::map<std::pair<std::uintmax_t, std::string>, std::vector<size_t>> by_partial;
+    for (size_t k = 0; k < candidates.size(); ++k) {
+        bytes_read += std::min(files[candidates[k]].size, 2 * kPartialHashBytes);
+        if (!partial[k].empty()) by_partial[{files[candidates[k]].size, partial[k]}].push_back(k);
+    }
+
+    // Groups of short files are already final; the rest need a full hash.
+    std::map<std::pair<std::uintmax_t, std::string>, std::vector<std::filesystem::path>> by_hash;
+    std::vector<size_t> full;
+    for (const auto& group : by_partial) {
+        if (group.second.size() < 2) continue;
+        for (size_t k : group.second) {
+            if (complete[k]) by_hash[group.first].push_back(files[candidates[k]].path);
+            else full.push_back(candidates[k]);
         }
-        std::cout << "] " << static_cast<int>(percentage) << "% (" << current_count << "/" << total_files << ")  ";
-        std::cout << std::flush;
     }
+    std::cout << full.size() << " candidates still match after partial hashing; hashing them fully..." << std::endl;
+
+    // 3. Full hashes, through the regular per-file path.
+    discovered_files_count = static_cast<int>(full.size());
+    discovery_complete = true;
+    run_on_pool(pool, full.size(), [&](size_t k) { process_file(files[full[k]].path); });
+    collect_results();
+    std::unordered_map<std::string, std::uintmax_t> full_sizes;
+    for (size_t i : full) {
+        full_sizes[files[i].path.string()] = files[i].size;
+        bytes_read += files[i].size;
+    }
+    for (const auto& result : results) by_hash[{full_sizes[result.first.string()], result.second}].push_back(result.first);
+
+    std::vector<DuplicateGroup> groups;
+    for (auto& group : by_hash) {
+        if (group.second.size() < 2) continue;
+        std::sort(group.second.begin(), group.second.end());
+        groups.push_back({group.first.first, group.first.second, std::move(group.second)});
+    }
+    // Largest wasted space first.
+    std::stable_sort(groups.begin(), groups.end(), [](const DuplicateGroup& a, const DuplicateGroup& b) {
+        return a.size * (a.paths.size() - 1) > b.size * (b.paths.size() - 1);
+    });
+    return groups;
+}
+
+void write_duplicates(const std::vector<DuplicateGroup>& groups, std::ostream& out) {
+    for (const DuplicateGroup& group : groups) {
+        out << group.hash << " (" << group.size << " bytes, " << group.paths.size() << " copies):\n";
+        for (const auto& path : group.paths) out << "  " << path.string() << "\n";
+    }
+    out << std::flush;
+}
+
+// Parse a byte count with an optional K, M or G suffix (powers of 1024).
+bool parse_size(const std::string& text, uint64_t& size) {
+    size_t end = 0;
+    unsigned long long value;
+    try { value = std::stoull(text, &end); } catch (...) { return false; }
+    std::string suffix = text.substr(end);
+    int shift = suffix.empty() ? 0 : suffix == "K" || suffix == "k" ? 10 : suffix == "M" || suffix == "m" ? 20 : suffix == "G" || suffix == "g" ? 30 : -1;
+    if (shift < 0 || value == 0 || value > (std::numeric_limits<uint64_t>::max() >> shift)) return false;
+    size = static_cast<uint64_t>(value) << shift;
+    return true;
 }
 
 void print_usage(const char* prog_name) {
@@ -65,61 +528,502 @@ void print_usage(const char* prog_name) {
     std::cerr << "  -r, --recursive       Scan directories recursively." << std::endl;
     std::cerr << "  --filter .ext1 .ext2  Only process files with the specified extensions." << std::endl;
     std::cerr << "  -o, --output <file>   Write the final hash report to a file instead of the console." << std::endl;
+    std::cerr << "  --io <mode>           File ingestion: read (large buffered reads), mmap, uring (asynchronous io_uring" << std::endl;
+    std::cerr << "                        reads, falling back to threads if unavailable) or threads (asynchronous pread threads)." << std::endl;
+    std::cerr << "                        Defaults to read." << std::endl;
+    std::cerr << "  --io-depth <n>        Reads kept in flight by the uring and threads modes. Defaults to 64." << std::endl;
+    std::cerr << "  --schedule <order>    Hashing order: fifo (discovery order) or lpt (largest file first). Prints the" << std::endl;
+    std::cerr << "                        achieved makespan against the ideal lower bound. Not available with uring/threads." << std::endl;
+    std::cerr << "  --tree-hash [chunk]   Hash each file as a Merkle tree of chunks (default 4M) so large files use every" << std::endl;
+    std::cerr << "                        thread. Digests are labelled sha256-tree-<chunk> and differ from plain SHA-256." << std::endl;
+    std::cerr << "  --duplicates          Report groups of identical files. Compares sizes first, then hashes of the first" << std::endl;
+    std::cerr << "                        and last 4 KB, and reads whole files only when those match. Empty files are ignored." << std::endl;
+    std::cerr << "  --stream              Append results to the -o file while hashing, in completion order, instead of" << std::endl;
+    std::cerr << "                        holding them all and writing a sorted report at the end." << std::endl;
+    std::cerr << "  --fsync <seconds>     With --stream, fsync the report at this interval. Defaults to 0 (only at the end)." << std::endl;
+    std::cerr << "                        Finished lines reach the file within a second either way." << std::endl;
+    std::cerr << "  --journal <file>      Record finished files in an append-only log. A rerun with the same journal skips" << std::endl;
+    std::cerr << "                        files already recorded whose size and mtime are unchanged. Not with --check or --duplicates." << std::endl;
+    std::cerr << "  --check <manifest>    Verify the tree against a report written with -o, or sha256sum output. Prints" << std::endl;
+    std::cerr << "                        OK, FAILED or MISSING per entry and exits non-zero unless all are OK." << std::endl;
+    std::cerr << "  --cache <file>        Digest cache for unchanged files. Defaults to ~/.cache/parallel-file-hasher/hashes.cache." << std::endl;
+    std::cerr << "  --no-cache            Neither read nor update the digest cache." << std::endl;
+    std::cerr << "  --rebuild-cache       Ignore cached digests and replace the cache with this run's results." << std::endl;
+    std::cerr << "  --stats               After the run, print phase times, aggregate, per-thread and per-worker" << std::endl;
+    std::cerr << "                        throughput, and per-file queue wait and latency by file size." << std::endl;
+    std::cerr << "  --trace <file.json>   Record a timeline of every worker (queue waits, tasks, file open, read, hash and" << std::endl;
+    std::cerr << "                        publish) in Chrome trace-event format, for Perfetto or chrome://tracing." << std::endl;
+    std::cerr << "  --metrics-file <file> Export live counters in Prometheus text format to this file (for node_exporter's" << std::endl;
+    std::cerr << "                        textfile collector), rewritten every --metrics-interval and at the end." << std::endl;
+    std::cerr << "  --metrics-port <port> Serve the same counters over HTTP on 127.0.0.1:<port>/metrics while running." << std::endl;
+    std::cerr << "  --metrics-interval <seconds> How often the metrics file is rewritten. Defaults to 15." << std::endl;
+    std::cerr << "  --hash-impl <impl>    SHA-256 kernel: auto, scalar or shani. Defaults to auto." << std::endl;
+    std::cerr << "  --multi-buffer <impl> Batch small files across SIMD lanes: auto, off, avx2 or avx512. Defaults to auto." << std::endl;
+    std::cerr << "  --self-test           Verify all supported SHA-256 kernels against known vectors and exit." << std::endl;
 }
 
 int main(int argc, char* argv[]) {
     // Argument parsing
     if (argc < 2) { print_usage(argv[0]); return 1; }
     std::vector<std::string> args(argv + 1, argv + argc);
+    if (args[0] == "--self-test") {
+        std::cout << "SHA-256 kernel self-test:" << std::endl;
+        return run_self_test() ? 0 : 1;
+    }
     std::filesystem::path directory_path = args[0];
     std::string output_file_path;
-    unsigned int num_threads = std::thread::hardware_concurrency();
+    // hardware_concurrency() is 0 when it cannot tell.
+    int thread_count = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
     bool recursive = false;
     std::unordered_set<std::string> filters;
+    std::string hash_impl = "auto";
+    std::string multi_buffer_impl = "auto";
+    std::string io_mode_name = "read";
+    size_t io_depth = 64;
+    std::string schedule;
+    bool tree_hash = false;
+    bool use_cache = true;
+    bool rebuild_cache = false;
+    std::filesystem::path cache_path;
+    std::filesystem::path check_path;
+    std::filesystem::path journal_path;
+    std::filesystem::path trace_path;
+    std::filesystem::path metrics_path;
+    int metrics_port = 0;
+    long metrics_interval = 15;
+    bool duplicates = false;
+    bool stream = false;
+    long fsync_seconds = 0;
+    uint64_t tree_chunk_size = TreeHasher::kDefaultChunkSize;
     for (size_t i = 1; i < args.size(); ++i) {
-        if (args[i] == "-j" && i + 1 < args.size()) { try { num_threads = std::stoi(args[++i]); } catch (...) {} } 
+        if (args[i] == "-j" && i + 1 < args.size()) { try { thread_count = std::stoi(args[++i]); } catch (...) { thread_count = 0; } } 
         else if (args[i] == "-r" || args[i] == "--recursive") { recursive = true; } 
         else if ((args[i] == "-o" || args[i] == "--output") && i + 1 < args.size()) { output_file_path = args[++i]; } 
         else if (args[i] == "--filter" && i + 1 < args.size()) { while (++i < args.size() && args[i][0] != '-') { filters.insert(args[i]); } --i; }
+        else if (args[i] == "--hash-impl" && i + 1 < args.size()) { hash_impl = args[++i]; }
+        else if (args[i] == "--io" && i + 1 < args.size()) { io_mode_name = args[++i]; }
+        else if (args[i].rfind("--io=", 0) == 0) { io_mode_name = args[i].substr(5); }
+        else if (args[i] == "--io-depth" && i + 1 < args.size()) { try { io_depth = std::stoul(args[++i]); } catch (...) {} }
+        else if (args[i] == "--multi-buffer" && i + 1 < args.size()) { multi_buffer_impl = args[++i]; }
+        else if (args[i] == "--schedule" && i + 1 < args.size()) { schedule = args[++i]; }
+        else if (args[i] == "--duplicates") { duplicates = true; }
+        else if (args[i] == "--trace" && i + 1 < args.size()) { trace_path = args[++i]; }
+        else if (args[i] == "--metrics-file" && i + 1 < args.size()) { metrics_path = args[++i]; }
+        else if (args[i] == "--metrics-port" && i + 1 < args.size()) { try { metrics_port = std::stoi(args[++i]); } catch (...) { metrics_port = -1; } }
+        else if (args[i] == "--metrics-interval" && i + 1 < args.size()) { try { metrics_interval = std::stol(args[++i]); } catch (...) {} }
+        else if (args[i] == "--stats") { run_stats = std::make_unique<RunStats>(); }
+        else if (args[i] == "--stream") { stream = true; }
+        else if (args[i] == "--fsync" && i + 1 < args.size()) { try { fsync_seconds = std::stol(args[++i]); } catch (...) {} }
+        else if (args[i] == "--journal" && i + 1 < args.size()) { journal_path = args[++i]; }
+        else if (args[i] == "--check" && i + 1 < args.size()) { check_path = args[++i]; }
+        else if (args[i] == "--cache" && i + 1 < args.size()) { cache_path = args[++i]; }
+        else if (args[i] == "--no-cache") { use_cache = false; }
+        else if (args[i] == "--rebuild-cache") { rebuild_cache = true; }
+        else if (args[i] == "--tree-hash") { tree_hash = true; if (i + 1 < args.size() && args[i + 1][0] != '-' && !parse_size(args[++i], tree_chunk_size)) { std::cerr << "Error: Invalid --tree-hash chunk size '" << args[i] << "'." << std::endl; return 1; } }
     }
     if (!std::filesystem::is_directory(directory_path)) { std::cerr << "Error: Not a valid directory." << std::endl; return 1; }
+    if (hash_impl == "scalar" || hash_impl == "shani") {
+        picosha2::block_impl impl = hash_impl == "shani" ? picosha2::block_impl::shani : picosha2::block_impl::scalar;
+        if (!picosha2::set_block_impl(impl)) { std::cerr << "Error: SHA-256 kernel '" << hash_impl << "' is not supported on this CPU." << std::endl; return 1; }
+    } else if (hash_impl != "auto") { std::cerr << "Error: Unknown --hash-impl '" << hash_impl << "'." << std::endl; return 1; }
+    const bool async_io = io_mode_name == "uring" || io_mode_name == "threads";
+#ifdef _WIN32
+    if (async_io) { std::cerr << "Error: --io " << io_mode_name << " is not available on Windows." << std::endl; return 1; }
+#endif
+    if (!async_io && !FileReader::parse_mode(io_mode_name, io_mode)) { std::cerr << "Error: Unknown --io mode '" << io_mode_name << "'." << std::endl; return 1; }
+    if (!schedule.empty() && schedule != "fifo" && schedule != "lpt") { std::cerr << "Error: Unknown --schedule '" << schedule << "'." << std::endl; return 1; }
+    // Asynchronous reads are ordered by the reader's own queue, not by pool tasks.
+    if (!schedule.empty() && async_io) { std::cerr << "Error: --schedule requires --io read or mmap." << std::endl; return 1; }
+    const bool largest_first = schedule == "lpt";
+    if (tree_hash && async_io) { std::cerr << "Error: --tree-hash requires --io read or mmap." << std::endl; return 1; }
+    // Chunks are timed nowhere, so the makespan report would be meaningless.
+    if (tree_hash && !schedule.empty()) { std::cerr << "Error: --tree-hash cannot be combined with --schedule." << std::endl; return 1; }
+    if (multi_buffer_impl == "auto") {
+        // Eight AVX2 lanes lose to a single SHA-NI stream, sixteen AVX-512 lanes do not.
+        MultiBufferHasher::Impl impl = MultiBufferHasher::detect();
+        if (impl == MultiBufferHasher::Impl::avx2 && picosha2::current_block_impl() == picosha2::block_impl::shani) impl = MultiBufferHasher::Impl::none;
+        multi_buffer_hasher = MultiBufferHasher(impl);
+    }
+    else if (multi_buffer_impl == "avx2" || multi_buffer_impl == "avx512") {
+        MultiBufferHasher::Impl impl = multi_buffer_impl == "avx2" ? MultiBufferHasher::Impl::avx2 : MultiBufferHasher::Impl::avx512;
+        if (!MultiBufferHasher::supported(impl)) { std::cerr << "Error: Multi-buffer engine '" << multi_buffer_impl << "' is not supported on this CPU." << std::endl; return 1; }
+        multi_buffer_hasher = MultiBufferHasher(impl);
+    } else if (multi_buffer_impl != "off") { std::cerr << "Error: Unknown --multi-buffer '" << multi_buffer_impl << "'." << std::endl; return 1; }
 
-    // File discovery
-    std::vector<std::filesystem::path> files_to_process;
-    std::cout << "Scanning for files..." << std::endl;
-    try {
-        if (recursive) {
-            for (const auto& entry : std::filesystem::recursive_directory_iterator(directory_path)) {
-                if (entry.is_regular_file() && (filters.empty() || filters.count(entry.path().extension().string()))) {
-                    files_to_process.push_back(entry.path());
+    if (duplicates && (async_io || tree_hash || !schedule.empty() || !check_path.empty())) {
+        std::cerr << "Error: --duplicates cannot be combined with --check, --tree-hash, --schedule or --io uring/threads." << std::endl;
+        return 1;
+    }
+    // A journalled file is reported without being read, which a check must never do.
+    if (!journal_path.empty() && (duplicates || !check_path.empty())) {
+        std::cerr << "Error: --journal cannot be combined with --check or --duplicates." << std::endl;
+        return 1;
+    }
+    update_cache = !duplicates;
+    if (thread_count < 1) { std::cerr << "Error: -j needs at least one thread." << std::endl; return 1; }
+    const unsigned int num_threads = static_cast<unsigned int>(thread_count);
+    if (metrics_port < 0 || metrics_port > 65535) { std::cerr << "Error: Invalid --metrics-port." << std::endl; return 1; }
+    if (stream && (output_file_path.empty() || duplicates || !check_path.empty())) {
+        std::cerr << "Error: --stream needs -o and cannot be combined with --check or --duplicates." << std::endl;
+        return 1;
+    }
+    // Verification must read every byte: bit rot leaves mtime untouched.
+    std::unique_ptr<Manifest> manifest;
+    if (!check_path.empty()) {
+        manifest = std::make_unique<Manifest>();
+        std::string error;
+        if (!manifest->load(check_path, error)) { std::cerr << "Error: Could not load manifest: " << error << std::endl; return 1; }
+        std::cout << "Checking against " << check_path.string() << " (" << manifest->entries().size() << " entries)." << std::endl;
+        use_cache = false;
+    }
+    if (!journal_path.empty()) {
+        journal = std::make_unique<Journal>();
+        std::string error;
+        if (!journal->open(journal_path, kJournalSyncInterval, error)) { std::cerr << "Error: Could not open journal: " << error << std::endl; return 1; }
+        if (journal->loaded()) std::cout << "Resuming from " << journal_path.string() << " (" << journal->loaded() << " files journalled)." << std::endl;
+    }
+    std::cout << "Scanning and hashing files (SHA-256 kernel: "
+              << picosha2::block_impl_name(picosha2::current_block_impl()) << ", multi-buffer: "
+              << MultiBufferHasher::name(multi_buffer_hasher.impl()) << ")..." << std::endl;
+    if (tree_hash) {
+        std::cout << "Tree hash: digests are " << TreeHasher::label(tree_chunk_size) << " Merkle roots, not plain SHA-256." << std::endl;
+        digest_prefix = TreeHasher::label(tree_chunk_size) + ":";
+        cache_kind = tree_chunk_size;
+    }
+    if (use_cache) {
+        if (cache_path.empty()) cache_path = HashCache::default_path();
+        if (!cache_path.empty()) hash_cache = std::make_unique<HashCache>(cache_path, rebuild_cache);
+    }
+
+    if (stream) {
+        report_writer = std::make_unique<ReportWriter>();
+        if (!report_writer->open(output_file_path, std::chrono::seconds(std::max(0L, fsync_seconds)))) {
+            std::cerr << "Error: Could not open output file." << std::endl;
+            return 1;
+        }
+        std::cout << "Streaming report to " << output_file_path << "..." << std::endl;
+    }
+    // Live counters for long runs. The pool gauges read the pool only while
+    // it exists; `live_pool` is cleared, under its mutex, once it has drained.
+    MetricsExporter metrics;
+    std::mutex live_pool_mutex;
+    ThreadPool* live_pool = nullptr;
+    if (!metrics_path.empty() || metrics_port != 0) {
+        using Type = MetricsExporter::Type;
+        auto pool_gauge = [&](size_t (ThreadPool::*gauge)() const) {
+            return [&live_pool_mutex, &live_pool, gauge] {
+                std::lock_guard<std::mutex> lock(live_pool_mutex);
+                return live_pool ? static_cast<double>((live_pool->*gauge)()) : 0.0;
+            };
+        };
+        metrics.add("file_hasher_files_discovered_total", "Files discovered and queued for hashing.", Type::counter,
+                    [] { return static_cast<double>(discovered_files_count.load()); });
+        metrics.add("file_hasher_files_hashed_total", "Files whose digest has been reported.", Type::counter,
+                    [] { return static_cast<double>(processed_files_count.load()); });
+        metrics.add("file_hasher_bytes_hashed_total", "Bytes read and hashed.", Type::counter,
+                    [] { return static_cast<double>(hashed_bytes_count.load()); });
+        metrics.add("file_hasher_read_errors_total", "Files that could not be read.", Type::counter,
+                    [] { return static_cast<double>(failed_files_count.load()); });
+        metrics.add("file_hasher_files_pending", "Files discovered but not yet hashed.", Type::gauge, [] {
+            return static_cast<double>(std::max(0, discovered_files_count.load() - processed_files_count.load() - failed_files_count.load()));
+        });
+        metrics.add("file_hasher_discovery_complete", "1 once the directory walk has finished.", Type::gauge,
+                    [] { return discovery_complete.load() ? 1.0 : 0.0; });
+        metrics.add("file_hasher_pool_queued_tasks", "Tasks waiting in the thread pool's queues.", Type::gauge, pool_gauge(&ThreadPool::queued_tasks));
+        metrics.add("file_hasher_pool_active_workers", "Pool workers currently running a task.", Type::gauge, pool_gauge(&ThreadPool::active_workers));
+        metrics.add("file_hasher_pool_workers", "Pool worker threads.", Type::gauge, [num_threads] { return static_cast<double>(num_threads); });
+        if (hash_cache) {
+            HashCache* cache = hash_cache.get();
+            metrics.add("file_hasher_cache_hits_total", "Files served from the digest cache.", Type::counter,
+                        [cache] { return static_cast<double>(cache->hits()); });
+            metrics.add("file_hasher_cache_misses_total", "Files looked up in the digest cache and hashed.", Type::counter,
+                        [cache] { return static_cast<double>(cache->misses()); });
+        }
+        if (journal) {
+            metrics.add("file_hasher_files_resumed_total", "Files reported from the journal of an interrupted run.", Type::counter,
+                        [] { return static_cast<double>(resumed_files_count.load()); });
+        }
+        const double start_time = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+        metrics.add("file_hasher_start_time_seconds", "Start of the run, in seconds since the Unix epoch.", Type::gauge,
+                    [start_time] { return start_time; });
+        std::string error;
+        if (!metrics.start(metrics_path, metrics_port, std::chrono::seconds(metrics_interval), error)) {
+            std::cerr << "Error: Could not start the metrics exporter: " << error << std::endl;
+            return 1;
+        }
+    }
+    ProgressRenderer progress({processed_files_count, discovered_files_count, hashed_bytes_count, discovery_complete}, cout_mutex);
+
+    // Discovery runs as directory tasks on the pool and hands each file over as
+    // soon as it is found, so hashing starts immediately. The pool is scoped so
+    // its destructor finishes all work before we print the results.
+    bool discovery_failed = false;
+    std::atomic<size_t> unlisted_count{0};
+    std::vector<DuplicateGroup> duplicate_groups;
+    std::uintmax_t duplicate_bytes_read = 0, total_bytes = 0;
+    if (!trace_path.empty()) {
+        Trace::start();
+        Trace::name_thread("main");
+    }
+    // Streamed lines reach the writer within kStreamFlushInterval even when
+    // no thread fills a batch, e.g. while every worker hashes a huge file.
+    std::mutex stream_flush_mutex;
+    std::condition_variable stream_flush_wake;
+    bool stream_flush_stop = false;
+    std::thread stream_flusher;
+    if (report_writer) {
+        stream_flusher = std::thread([&] {
+            std::unique_lock<std::mutex> lock(stream_flush_mutex);
+            while (!stream_flush_wake.wait_for(lock, kStreamFlushInterval, [&] { return stream_flush_stop; })) {
+                lock.unlock();
+                flush_streamed_results();
+                lock.lock();
+            }
+        });
+    }
+    std::vector<ThreadPool::WorkerStats> worker_stats;
+    const int64_t run_start_ns = now_ns();
+    int64_t discovery_end_ns = run_start_ns;
+    {
+        ThreadPool pool(num_threads, ThreadPool::kDefaultQueueCapacity, run_stats ? &worker_stats : nullptr);
+        {
+            std::lock_guard<std::mutex> lock(live_pool_mutex);
+            live_pool = &pool;
+        }
+#ifndef _WIN32
+        // Asynchronous I/O: a dedicated reader keeps `io_depth` reads in flight
+        // and the pool threads only hash the blocks it delivers.
+        std::unique_ptr<AsyncReader> async_reader;
+        if (async_io) {
+            async_reader = std::make_unique<AsyncReader>(pool, io_mode_name == "uring" ? AsyncReader::Backend::uring : AsyncReader::Backend::pread, io_depth);
+            std::lock_guard<std::mutex> lock(cout_mutex);
+            std::cout << "Reading with " << AsyncReader::backend_name(async_reader->backend()) << ", queue depth " << io_depth << "." << std::endl;
+        }
+#endif
+        // The multi-buffer engine computes plain SHA-256, so tree mode skips it.
+        const size_t lanes = async_io || tree_hash || duplicates ? 1 : multi_buffer_hasher.lanes();
+        // File tasks hold their own copy: they may still run while this
+        // scope unwinds, until the pool destructor has drained the queue.
+        const TreeHasher tree_hasher(pool, tree_chunk_size, &hashed_bytes_count);
+        std::vector<FileEntry> small_files;
+        std::mutex small_files_mutex;
+        // Caller holds small_files_mutex.
+        auto flush_small_files = [&] {
+            std::sort(small_files.begin(), small_files.end(),
+                      [](const FileEntry& a, const FileEntry& b) { return a.size < b.size; });
+            for (size_t first = 0; first < small_files.size(); first += lanes) {
+                std::vector<std::filesystem::path> batch;
+                uint64_t bytes = 0;
+                for (size_t i = first; i < std::min(first + lanes, small_files.size()); ++i) {
+                    batch.push_back(std::move(small_files[i].path));
+                    bytes += small_files[i].size;
                 }
+                Task task = [batch = std::move(batch), queued = run_stats ? now_ns() : 0] {
+                    run_timed([&] { process_small_files(batch, queued); });
+                };
+                if (largest_first) pool.enqueue(std::move(task), bytes); else pool.enqueue(std::move(task));
             }
-        } else {
-            for (const auto& entry : std::filesystem::directory_iterator(directory_path)) {
-                if (entry.is_regular_file() && (filters.empty() || filters.count(entry.path().extension().string()))) {
-                    files_to_process.push_back(entry.path());
+            small_files.clear();
+        };
+        // Hand over one directory's worth of discovered files.
+        // In duplicates mode nothing is hashed until every size is known.
+        std::vector<FileEntry> all_files;
+        std::mutex all_files_mutex;
+        auto dispatch = [&](std::vector<FileEntry>& files) {
+            if (duplicates) {
+                std::lock_guard<std::mutex> lock(all_files_mutex);
+                std::move(files.begin(), files.end(), std::back_inserter(all_files));
+                return;
+            }
+            // In check mode only files listed in the manifest are hashed.
+            if (manifest) {
+                auto listed_end = std::remove_if(files.begin(), files.end(),
+                                                 [&](const FileEntry& file) { return manifest->find(file.path) == Manifest::npos; });
+                unlisted_count += static_cast<size_t>(files.end() - listed_end);
+                files.erase(listed_end, files.end());
+            }
+            discovered_files_count += static_cast<int>(files.size());
+            // Files finished before an interruption are reported without reading them.
+            if (journal && journal->loaded()) {
+                files.erase(std::remove_if(files.begin(), files.end(), [](const FileEntry& file) { return serve_from_journal(file.path); }),
+                            files.end());
+            }
+#ifndef _WIN32
+            if (async_reader) {
+                for (FileEntry& file : files) {
+                    std::optional<HashCache::Key> key;
+                    if (serve_from_cache(file.path, key)) continue;
+                    auto hasher = std::make_shared<picosha2::hash256_one_by_one>();
+                    const int64_t queued = run_stats ? now_ns() : 0;
+                    async_reader->submit(file.path,
+                        [hasher](const unsigned char* data, size_t size) {
+                            hasher->process(data, data + size);
+                            hashed_bytes_count.fetch_add(size, std::memory_order_relaxed);
+                        },
+                        [hasher, path = file.path, key, size = file.size, queued](bool ok) {
+                            if (!ok) { failed_files_count.fetch_add(1, std::memory_order_relaxed); return; }
+                            hasher->finish();
+                            HashCache::Digest digest;
+                            hasher->get_hash_bytes(digest.begin(), digest.end());
+                            record_digest(path, digest, key);
+                            // Reads are queued inside the reader, so the whole time counts as latency.
+                            if (run_stats) run_stats->record(size, queued, queued, now_ns());
+                        });
                 }
+                return;
             }
-        }
-    } catch (const std::filesystem::filesystem_error& e) { std::cerr << "Filesystem error: " << e.what() << std::endl; return 1; }
-    total_files = files_to_process.size();
-    if (total_files == 0) { std::cout << "No matching files found." << std::endl; return 0; }
-    std::cout << "Found " << total_files << " files. Starting processing..." << std::endl;
-
-    // Create a scope for the ThreadPool to ensure its destructor is called
-    // before we try to print the results.
-    {
-        ThreadPool pool(num_threads);
-        for (const auto& path : files_to_process) {
-            pool.enqueue([path] {
-                process_file(path);
+#endif
+            if (lanes > 1) {
+                std::lock_guard<std::mutex> lock(small_files_mutex);
+                auto large = std::partition(files.begin(), files.end(),
+                                            [](const FileEntry& file) { return file.size <= kSmallFileThreshold; });
+                for (auto it = files.begin(); it != large; ++it) {
+                    small_files.push_back(std::move(*it));
+                    if (small_files.size() >= lanes * kSmallFileWindowBatches) flush_small_files();
+                }
+                files.erase(files.begin(), large);
+            }
+            if (files.empty()) return;
+            if (tree_hash) {
+                for (FileEntry& file : files) {
+                    pool.enqueue([tree_hasher, path = std::move(file.path), queued = run_stats ? now_ns() : 0] {
+                        std::optional<HashCache::Key> key;
+                        if (serve_from_cache(path, key)) return;
+                        const int64_t start = run_stats ? now_ns() : 0;
+                        tree_hasher.hash(path, [path, key, queued, start](bool ok, const TreeHasher::Digest& root, uint64_t size) {
+                            if (!ok) { failed_files_count.fetch_add(1, std::memory_order_relaxed); return; }
+                            record_digest(path, root, key);
+                            if (run_stats) run_stats->record(size, queued, start, now_ns());
+                        });
+                    });
+                }
+                return;
+            }
+            // Largest first: the priority queue serves the biggest waiting file
+            // next. Discovery runs well ahead of hashing, so the backlog it
+            // reorders is normally most of the tree.
+            if (largest_first) {
+                for (FileEntry& file : files) {
+                    pool.enqueue([path = std::move(file.path), queued = run_stats ? now_ns() : 0] {
+                        run_timed([&] { process_file(path, queued); });
+                    }, file.size);
+                }
+                return;
+            }
+            // Otherwise the rest go to the pool as one range task over the batch.
+            auto batch = std::make_shared<std::vector<FileEntry>>(std::move(files));
+            pool.enqueue_range(0, batch->size(), [batch, queued = run_stats ? now_ns() : 0](size_t i) {
+                run_timed([&] { process_file((*batch)[i].path, queued); });
             });
+        };
+        DirectoryWalker::NameFilter accept;
+        if (!filters.empty()) {
+            accept = [&filters](const std::string& name) { return filters.count(std::filesystem::path(name).extension().string()) > 0; };
+        }
+        // Sizes cost a stat per file and are only needed to spot small files,
+        // to order by size and for the statistics of asynchronous reads.
+        DirectoryWalker walker(pool, dispatch, accept, lanes > 1 || largest_first || duplicates || (run_stats && async_io));
+        walker.walk(directory_path, recursive);
+        walker.wait();
+        discovery_end_ns = now_ns();
+        for (const std::string& error : walker.errors()) {
+            std::lock_guard<std::mutex> lock(cout_mutex);
+            std::cerr << std::endl << "Filesystem error: " << error << std::endl;
+            discovery_failed = true;
         }
-    } 
+        {
+            std::lock_guard<std::mutex> lock(small_files_mutex);
+            flush_small_files();
+        }
+        discovery_complete = true;
+        if (duplicates) {
+            for (const FileEntry& file : all_files) total_bytes += file.size == DirectoryWalker::kUnknownSize ? 0 : file.size;
+            duplicate_groups = find_duplicates(pool, all_files, duplicate_bytes_read);
+        }
+#ifndef _WIN32
+        if (async_reader) async_reader->wait();
+#endif
+        pool.shutdown();
+        std::lock_guard<std::mutex> lock(live_pool_mutex);
+        live_pool = nullptr;
+    }
+    const int64_t hashing_end_ns = now_ns();
+    metrics.stop();
+    if (stream_flusher.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(stream_flush_mutex);
+            stream_flush_stop = true;
+        }
+        stream_flush_wake.notify_one();
+        stream_flusher.join();
+    }
+    progress.stop();
+    if (!trace_path.empty()) {
+        std::string error;
+        if (Trace::write(trace_path, error)) std::cout << "Trace written to " << trace_path.string() << "." << std::endl;
+        else std::cerr << "Error: Could not write trace: " << error << std::endl;
+    }
+    collect_results();
+    // Report writing is timed from here to each call.
+    auto print_stats = [&] {
+        if (!run_stats) return;
+        RunStats::Phases phases{(discovery_end_ns - run_start_ns) / 1e9, (hashing_end_ns - run_start_ns) / 1e9,
+                                (now_ns() - hashing_end_ns) / 1e9};
+        run_stats->print(std::cout, phases, hashed_bytes_count, worker_stats);
+    };
+    if (journal) {
+        if (!journal->close()) std::cerr << "Error: Writing the journal failed." << std::endl;
+        std::cout << "Journal: " << resumed_files_count << " files resumed, " << journal->appended() << " recorded." << std::endl;
+    }
+    if (manifest) {
+        CheckCounts counts;
+        if (!output_file_path.empty()) {
+            std::cout << "Writing check report to " << output_file_path << "..." << std::endl;
+            std::ofstream output_file(output_file_path);
+            if (!output_file.is_open()) { std::cerr << "Error: Could not open output file." << std::endl; return 1; }
+            counts = report_check(*manifest, output_file);
+        } else {
+            std::cout << "--- Check Report ---" << std::endl;
+            counts = report_check(*manifest, std::cout);
+            std::cout << "--------------------" << std::endl;
+        }
+        std::cout << "Check: " << counts.ok << " OK, " << counts.failed << " FAILED, " << counts.missing << " MISSING";
+        if (unlisted_count) std::cout << "; " << unlisted_count << " files not in the manifest were skipped";
+        std::cout << "." << std::endl;
+        print_stats();
+        return counts.failed || counts.missing || discovery_failed ? 1 : 0;
+    }
+    if (duplicates) {
+        if (!output_file_path.empty()) {
+            std::cout << "Writing duplicate report to " << output_file_path << "..." << std::endl;
+            std::ofstream output_file(output_file_path);
+            if (!output_file.is_open()) { std::cerr << "Error: Could not open output file." << std::endl; return 1; }
+            write_duplicates(duplicate_groups, output_file);
+        } else {
+            std::cout << "--- Duplicate Report ---" << std::endl;
+            write_duplicates(duplicate_groups, std::cout);
+            std::cout << "------------------------" << std::endl;
+        }
+        std::uintmax_t redundant_files = 0, redundant_bytes = 0;
+        for (const DuplicateGroup& group : duplicate_groups) {
+            redundant_files += group.paths.size() - 1;
+            redundant_bytes += group.size * (group.paths.size() - 1);
+        }
+        std::cout << duplicate_groups.size() << " duplicate groups, " << redundant_files << " redundant files ("
+                  << redundant_bytes << " bytes). Read at most " << duplicate_bytes_read << " of " << total_bytes << " bytes." << std::endl;
+        print_stats();
+        return discovery_failed ? 1 : 0;
+    }
+    if (report_writer) {
+        flush_streamed_results();
+        if (!report_writer->close()) { std::cerr << "Error: Writing the report failed." << std::endl; return 1; }
+    }
+    if (discovered_files_count == 0) { std::cout << "No matching files found." << std::endl; return discovery_failed ? 1 : 0; }
 
     // Final report logic
-    std::cout << std::endl;
-    if (!output_file_path.empty()) {
+    if (report_writer) {
+        // Already written while hashing.
+    } else if (!output_file_path.empty()) {
         std::cout << "Writing report to " << output_file_path << "..." << std::endl;
         std::ofstream output_file(output_file_path);
         if (!output_file.is_open()) { std::cerr << "Error: Could not open output file." << std::endl; } 
@@ -130,5 +1034,20 @@ int main(int argc, char* argv[]) {
         std::cout << "-------------------" << std::endl;
     }
     std::cout << "All files processed." << std::endl;
-    return 0;
+    if (hash_cache) {
+        std::cout << "Cache: " << hash_cache->hits() << " hits, " << hash_cache->misses() << " misses ("
+                  << hash_cache->file().string() << ")." << std::endl;
+        if (!hash_cache->save()) std::cerr << "Error: Could not write cache " << hash_cache->file().string() << "." << std::endl;
+    }
+    if (!schedule.empty() && last_task_end_ns > 0) {
+        // No schedule on P threads can beat the total work spread evenly, nor
+        // the single longest task.
+        double makespan = (last_task_end_ns - first_task_start_ns) / 1e9;
+        double lower_bound = std::max(task_busy_ns / 1e9 / num_threads, longest_task_ns / 1e9);
+        std::cout << "Schedule " << schedule << ": makespan " << std::fixed << std::setprecision(3) << makespan
+                  << " s, lower bound " << lower_bound << " s (" << std::setprecision(1)
+                  << (makespan > 0 ? 100.0 * lower_bound / makespan : 100.0) << "% of ideal)." << std::endl;
+    }
+    print_stats();
+    return discovery_failed ? 1 : 0;
 }